@@ -6,6 +6,9 @@
 //-------------------------------------------------------------------------
 
 #include "ActivationFunctions.h"
+#include <algorithm>
+#include <charconv>
+#include <format>
 #include <ranges>
 #include <stdexcept>
 
@@ -13,21 +16,78 @@ namespace bpn {
 
 	std::unique_ptr<ActivationFunction> ActivationFunction::deserialize(std::string_view s)
 	{
-		if (s.contains("Sigmoid("))
+		if (std::size_t const open = s.find("Sigmoid("); open != std::string_view::npos)
 		{
-			auto is_digit = [](char c) { return std::isdigit(c); };
-			double lambda = *std::ranges::find_if(s, is_digit) - '0';
+			// The whole lambda, e.g. ``Sigmoid(0.5)`` or ``Sigmoid(12)``
+			std::string_view const arguments = s.substr(open + 8);
+			double lambda = 0.0;
+			auto const [end, ec] = std::from_chars(arguments.data(), arguments.data() + arguments.size(), lambda);
+			if (ec != std::errc() || end == arguments.data() + arguments.size() || *end != ')')
+			{
+				throw std::runtime_error(std::format("Invalid sigmoid lambda in `{}`", s));
+			}
 			return std::make_unique<Sigmoid>(lambda);
 		}
+		else if (s.contains("LeakyReLU"))
+		{
+			return std::make_unique<LeakyReLU>();
+		}
 		else if (s.contains("ReLU"))
 		{
 			return std::make_unique<ReLU>();
 		}
-		else if (s.contains("LeakyReLU"))
+
+		throw std::runtime_error("Unknown activation function");
+	}
+
+	std::vector<std::shared_ptr<const ActivationFunction>> ActivationFunction::deserializeList(std::string_view s, std::size_t count)
+	{
+		// Split on commas that are not between parentheses
+		std::vector<std::shared_ptr<const ActivationFunction>> functions;
+		std::size_t first = 0;
+		int depth = 0;
+		for (std::size_t i = 0; i <= s.size(); ++i)
 		{
-			return std::make_unique<LeakyReLU>();
+			if (i == s.size() || (s[i] == ',' && depth == 0))
+			{
+				functions.push_back(deserialize(s.substr(first, i - first)));
+				first = i + 1;
+			}
+			else if (s[i] == '(')
+			{
+				++depth;
+			}
+			else if (s[i] == ')')
+			{
+				--depth;
+			}
 		}
 
-		throw std::runtime_error("Unknown activation function");
+		if (functions.size() == 1)
+		{
+			functions.resize(count, functions.front());
+		}
+		if (functions.size() != count)
+		{
+			throw std::runtime_error(std::format("Expected {} activation functions, got `{}`", count, s));
+		}
+		return functions;
+	}
+
+	std::string ActivationFunction::serializeList(const std::vector<std::shared_ptr<const ActivationFunction>>& functions)
+	{
+		std::string const first = functions.front()->serialize();
+		bool const uniform = std::ranges::all_of(functions, [&first](const auto& f) { return f->serialize() == first; });
+		if (uniform)
+		{
+			return first;
+		}
+
+		std::string s = first;
+		for (std::size_t i = 1; i < functions.size(); ++i)
+		{
+			s += ',' + functions[i]->serialize();
+		}
+		return s;
 	}
 }
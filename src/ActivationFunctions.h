@@ -12,6 +12,8 @@
 #include <string_view>
 #include <format>
 #include <memory>
+#include <vector>
+#include <cstddef>
 
 namespace bpn
 {
@@ -34,15 +36,95 @@ namespace bpn
 		 */
 		virtual double evalDerivative(double x, double fx = 0.0) const = 0;
 
+		/**
+		 * Epilogue of a layer evaluation, for i in [0, n) :
+		 *     x[i] += bias[i]
+		 *     fx[i] = f(x[i])
+		 *
+		 * ``x`` holds the weighted sums of the layer, ``bias`` the weights of
+		 * the bias neuron, ``fx`` may be ``x``. Implementations apply f
+		 * without a virtual call per neuron.
+		 */
+		virtual void evaluateLayer(double* x, double* fx, const double* __restrict bias, std::size_t n) const
+		{
+			for (std::size_t i = 0; i < n; ++i)
+			{
+				x[i] += bias[i];
+				fx[i] = evaluate(x[i]);
+			}
+		}
+
+		/**
+		 * Backward counterpart of ``evaluateLayer``, for i in [0, n) :
+		 *     gradients[i] *= f'(x[i])
+		 *
+		 * ``fx`` holds the values f(x[i]) computed by the forward pass.
+		 */
+		virtual void multiplyDerivative(const double* x, const double* fx, double* __restrict gradients, std::size_t n) const
+		{
+			for (std::size_t i = 0; i < n; ++i)
+			{
+				gradients[i] *= evalDerivative(x[i], fx[i]);
+			}
+		}
+
 		/**
 		 * Representation of the function as text.
 		 */
 		virtual std::string serialize() const = 0;
 
+		/**
+		 * C++ expression computing f(``x``), for the generated inference code
+		 * (see CodeGenerator.h).
+		 */
+		virtual std::string generateCode(std::string_view x) const = 0;
+
 		static std::unique_ptr<ActivationFunction> deserialize(std::string_view s);
+
+		/**
+		 * Parses a comma separated list of ``count`` activation functions, one
+		 * per layer (e.g. ``ReLU,ReLU,Sigmoid(1)``). A single function is used
+		 * for every layer.
+		 */
+		static std::vector<std::shared_ptr<const ActivationFunction>> deserializeList(std::string_view s, std::size_t count);
+
+		/**
+		 * Inverse of ``deserializeList``, a single name when every layer uses
+		 * the same function.
+		 */
+		static std::string serializeList(const std::vector<std::shared_ptr<const ActivationFunction>>& functions);
+	};
+
+	/**
+	 * ``evaluateLayer`` and ``multiplyDerivative`` of a final ``Derived``,
+	 * whose ``evaluate`` and ``evalDerivative`` are then called without a
+	 * virtual call and can be inlined in the loops.
+	 */
+	template<typename Derived>
+	class ActivationFunctionImpl : public ActivationFunction
+	{
+	public:
+		void evaluateLayer(double* x, double* fx, const double* __restrict bias, std::size_t n) const override
+		{
+			const Derived& f = static_cast<const Derived&>(*this);
+			for (std::size_t i = 0; i < n; ++i)
+			{
+				x[i] += bias[i];
+				fx[i] = f.evaluate(x[i]);
+			}
+		}
+
+		void multiplyDerivative(const double* x, const double* fx, double* __restrict gradients, std::size_t n) const override
+		{
+			const Derived& f = static_cast<const Derived&>(*this);
+			for (std::size_t i = 0; i < n; ++i)
+			{
+				gradients[i] *= f.evalDerivative(x[i], fx[i]);
+			}
+		}
 	};
 
-	class Sigmoid : public ActivationFunction
+	class Sigmoid final : public ActivationFunctionImpl<Sigmoid>
 	{
 		/**
 		 *                   1
@@ -74,10 +156,15 @@ namespace bpn
 			return std::format("Sigmoid({})", lambda);
 		}
 
+		std::string generateCode(std::string_view x) const override
+		{
+			return std::format("1.0 / (1.0 + std::exp(-({}) * ({})))", lambda, x);
+		}
+
 		const double lambda;
 	};
 
-	class ReLU : public ActivationFunction
+	class ReLU final : public ActivationFunctionImpl<ReLU>
 	{
 		/**
 		 *
@@ -102,9 +189,14 @@ namespace bpn
 		{
 			return "ReLU";
 		}
+
+		std::string generateCode(std::string_view x) const override
+		{
+			return std::format("({} > 0) ? {} : 0.0", x, x);
+		}
 	};
 
-	class LeakyReLU : public ActivationFunction
+	class LeakyReLU final : public ActivationFunctionImpl<LeakyReLU>
 	{
 		/**
 		 * Like ReLU but in case of a negative input x, then the ouput is x/100
@@ -128,5 +220,10 @@ namespace bpn
 		{
 			return "LeakyReLU";
 		}
+
+		std::string generateCode(std::string_view x) const override
+		{
+			return std::format("({} > 0) ? {} : 0.01 * {}", x, x, x);
+		}
 	};
 }
\ No newline at end of file
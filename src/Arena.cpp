@@ -0,0 +1,107 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+
+#include "Arena.h"
+#include <cstring>
+#include <utility>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace bpn
+{
+	Arena::Arena(std::size_t bytes)
+		: m_size{ bytes }
+		, m_capacity{ align(bytes) }
+	{
+		if (m_capacity == 0)
+		{
+			return;
+		}
+
+#if defined(__linux__)
+		if (s_useHugePages && m_capacity >= HugePageSize)
+		{
+			// Anonymous mappings are zeroed and page aligned
+			m_capacity = (m_capacity + HugePageSize - 1) & ~(HugePageSize - 1);
+			void* p = ::mmap(nullptr, m_capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (p != MAP_FAILED)
+			{
+				::madvise(p, m_capacity, MADV_HUGEPAGE);
+				m_data = static_cast<std::byte*>(p);
+				m_mapped = true;
+				return;
+			}
+			m_capacity = align(bytes);
+		}
+#endif
+
+		m_data = static_cast<std::byte*>(::operator new(m_capacity, std::align_val_t{ Alignment }));
+		std::memset(m_data, 0, m_capacity);
+	}
+
+	Arena::Arena(const Arena& other)
+		: Arena(other.m_size)
+	{
+		if (m_size > 0)
+		{
+			std::memcpy(m_data, other.m_data, m_size);
+		}
+	}
+
+	Arena::Arena(Arena&& other) noexcept
+		: m_data{ std::exchange(other.m_data, nullptr) }
+		, m_size{ std::exchange(other.m_size, 0) }
+		, m_capacity{ std::exchange(other.m_capacity, 0) }
+		, m_mapped{ std::exchange(other.m_mapped, false) }
+	{
+	}
+
+	Arena& Arena::operator=(const Arena& other)
+	{
+		if (this != &other)
+		{
+			*this = Arena(other);
+		}
+		return *this;
+	}
+
+	Arena& Arena::operator=(Arena&& other) noexcept
+	{
+		if (this != &other)
+		{
+			release();
+			m_data = std::exchange(other.m_data, nullptr);
+			m_size = std::exchange(other.m_size, 0);
+			m_capacity = std::exchange(other.m_capacity, 0);
+			m_mapped = std::exchange(other.m_mapped, false);
+		}
+		return *this;
+	}
+
+	Arena::~Arena()
+	{
+		release();
+	}
+
+	void Arena::release() noexcept
+	{
+		if (m_data == nullptr)
+		{
+			return;
+		}
+#if defined(__linux__)
+		if (m_mapped)
+		{
+			::munmap(m_data, m_capacity);
+			m_data = nullptr;
+			return;
+		}
+#endif
+		::operator delete(m_data, std::align_val_t{ Alignment });
+		m_data = nullptr;
+	}
+}
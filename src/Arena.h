@@ -0,0 +1,115 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+// One block of 64-byte aligned memory from which the hot arrays of the
+// network (activations, values, error gradients) are carved.
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+namespace bpn
+{
+	class Arena
+	{
+	public:
+		// Cache line size, every array carved from the arena starts on one
+		static constexpr std::size_t Alignment = 64;
+
+		// Size of a transparent huge page on x86-64 Linux
+		static constexpr std::size_t HugePageSize = std::size_t{ 2 } << 20;
+
+		Arena() noexcept = default;
+
+		/**
+		 * Allocates ``bytes`` zero-initialized bytes. When huge pages are
+		 * enabled and the block is at least one huge page large, it is backed
+		 * by transparent huge pages (Linux only, ignored elsewhere).
+		 */
+		explicit Arena(std::size_t bytes);
+
+		Arena(const Arena& other);
+		Arena(Arena&& other) noexcept;
+		Arena& operator=(const Arena& other);
+		Arena& operator=(Arena&& other) noexcept;
+		~Arena();
+
+		// ``bytes`` rounded up to a multiple of Alignment
+		[[nodiscard]] static constexpr std::size_t align(std::size_t bytes) noexcept
+		{
+			return (bytes + Alignment - 1) & ~(Alignment - 1);
+		}
+
+		// Array of type T starting ``offset`` bytes after the beginning of the arena
+		template<typename T>
+		[[nodiscard]] T* get(std::size_t offset) noexcept
+		{
+			return std::launder(reinterpret_cast<T*>(m_data + offset));
+		}
+
+		template<typename T>
+		[[nodiscard]] const T* get(std::size_t offset) const noexcept
+		{
+			return std::launder(reinterpret_cast<const T*>(m_data + offset));
+		}
+
+		[[nodiscard]] std::size_t size() const noexcept
+		{
+			return m_size;
+		}
+
+		// Bytes actually reserved, including the huge page rounding
+		[[nodiscard]] std::size_t byteSize() const noexcept
+		{
+			return m_capacity;
+		}
+
+		// Whether the arenas allocated from now on may use huge pages
+		static void setUseHugePages(bool useHugePages) noexcept
+		{
+			s_useHugePages = useHugePages;
+		}
+
+	private:
+		void release() noexcept;
+
+		std::byte*  m_data = nullptr;
+		std::size_t m_size = 0;
+		std::size_t m_capacity = 0;
+		bool        m_mapped = false;   // allocated with mmap instead of operator new
+
+		inline static bool s_useHugePages = false;
+	};
+
+	/**
+	 * Standard allocator giving Arena::Alignment aligned storage, so that
+	 * std::vector buffers start on a cache line too.
+	 */
+	template<typename T>
+	struct AlignedAllocator
+	{
+		using value_type = T;
+
+		AlignedAllocator() noexcept = default;
+		template<typename U>
+		AlignedAllocator(const AlignedAllocator<U>&) noexcept {}
+
+		[[nodiscard]] T* allocate(std::size_t n)
+		{
+			return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t{ Arena::Alignment }));
+		}
+
+		void deallocate(T* p, std::size_t) noexcept
+		{
+			::operator delete(p, std::align_val_t{ Arena::Alignment });
+		}
+
+		template<typename U>
+		bool operator==(const AlignedAllocator<U>&) const noexcept
+		{
+			return true;
+		}
+	};
+}
@@ -0,0 +1,50 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+
+#include "AtomicFile.h"
+#include <format>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+
+namespace bpn
+{
+	void writeFileAtomically(std::filesystem::path const& path, std::function<void(std::ostream&)> const& writer)
+	{
+		std::filesystem::path temporaryPath = path;
+		temporaryPath += ".tmp";
+
+		std::error_code ec;
+		try
+		{
+			std::ofstream file(temporaryPath, std::ios::out | std::ios::binary | std::ios::trunc);
+			if (!file)
+			{
+				throw std::runtime_error(std::format("Unable to create `{}`", temporaryPath.string()));
+			}
+			writer(file);
+			if (!file.flush())
+			{
+				ec = std::make_error_code(std::errc::io_error);
+			}
+		}
+		catch (...)
+		{
+			std::filesystem::remove(temporaryPath, ec);
+			throw;
+		}
+
+		if (!ec)
+		{
+			std::filesystem::rename(temporaryPath, path, ec);
+		}
+		if (ec)
+		{
+			std::error_code ignored;
+			std::filesystem::remove(temporaryPath, ignored);
+			throw std::runtime_error(std::format("Unable to write `{}`: {}", path.string(), ec.message()));
+		}
+	}
+}
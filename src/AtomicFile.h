@@ -0,0 +1,21 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <ostream>
+
+namespace bpn
+{
+	/**
+	 * Writes ``path`` with ``writer`` into a temporary file beside it, then
+	 * renames it over ``path``, so that an interrupted or concurrent run
+	 * never reads a truncated file. Throws if the file cannot be written or
+	 * renamed, after removing the temporary file; ``path`` is left as it was.
+	 */
+	void writeFileAtomically(std::filesystem::path const& path, std::function<void(std::ostream&)> const& writer);
+}
@@ -0,0 +1,356 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+
+#include "Augmentation.h"
+#include "NeuralNetworkTrainer.h"
+#include "Parameters.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <format>
+#include <limits>
+#include <numbers>
+#include <stdexcept>
+
+namespace bpn
+{
+	namespace
+	{
+		// Seed of the distortions of sample ``index`` during ``epoch`` (splitmix64)
+		uint64_t sampleSeed(uint64_t epoch, uint64_t index)
+		{
+			uint64_t z = epoch * 0x9E3779B97F4A7C15ull + index + 1;
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+			return z ^ (z >> 31);
+		}
+	}
+
+	Augmenter::Augmenter(int32_t size, double maxShift, double maxRotation, double elasticAlpha, double elasticSigma)
+		: size{ size }
+		, maxShift{ maxShift }
+		, maxRotation{ maxRotation }
+		, elasticAlpha{ elasticAlpha }
+		, elasticSigma{ elasticSigma }
+	{
+		int32_t const radius = elasticSigma > 0.0 ? static_cast<int32_t>(std::ceil(3.0 * elasticSigma)) : 0;
+		double sum = 0.0;
+		for (int32_t i = -radius; i <= radius; ++i)
+		{
+			double const k = radius > 0 ? std::exp(-0.5 * i * i / (elasticSigma * elasticSigma)) : 1.0;
+			m_kernel.push_back(k);
+			sum += k;
+		}
+		for (double& k : m_kernel)
+		{
+			k /= sum;
+		}
+	}
+
+	void Augmenter::augment(const double* in, double* out, std::mt19937_64& rng) const
+	{
+		std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+		double const theta = maxRotation * uniform(rng) * std::numbers::pi / 180.0;
+		double const dx = maxShift * uniform(rng);
+		double const dy = maxShift * uniform(rng);
+		double const cosTheta = std::cos(theta);
+		double const sinTheta = std::sin(theta);
+		double const center = (size - 1) / 2.0;
+		std::size_t const numPixels = static_cast<std::size_t>(size) * size;
+
+		// Displacement fields, reused by the calls on the same thread
+		thread_local std::vector<double> ex, ey, tmp;
+		bool const elastic = elasticAlpha > 0.0;
+		if (elastic)
+		{
+			ex.resize(numPixels);
+			ey.resize(numPixels);
+			tmp.resize(numPixels);
+			for (std::size_t i = 0; i < numPixels; ++i)
+			{
+				ex[i] = uniform(rng);
+				ey[i] = uniform(rng);
+			}
+			blur(ex.data(), tmp.data());
+			blur(ey.data(), tmp.data());
+		}
+
+		auto pixel = [&](int32_t x, int32_t y)
+		{
+			return (x >= 0 && x < size && y >= 0 && y < size) ? in[y * size + x] : 0.0;
+		};
+
+		for (int32_t y = 0; y < size; ++y)
+		{
+			for (int32_t x = 0; x < size; ++x)
+			{
+				std::size_t const i = static_cast<std::size_t>(y) * size + x;
+				double sx = cosTheta * (x - center) - sinTheta * (y - center) + center - dx;
+				double sy = sinTheta * (x - center) + cosTheta * (y - center) + center - dy;
+				if (elastic)
+				{
+					sx += elasticAlpha * ex[i];
+					sy += elasticAlpha * ey[i];
+				}
+
+				// Bilinear interpolation
+				double const x0 = std::floor(sx);
+				double const y0 = std::floor(sy);
+				double const fx = sx - x0;
+				double const fy = sy - y0;
+				int32_t const ix = static_cast<int32_t>(x0);
+				int32_t const iy = static_cast<int32_t>(y0);
+				out[i] = (1.0 - fy) * ((1.0 - fx) * pixel(ix, iy) + fx * pixel(ix + 1, iy))
+					+ fy * ((1.0 - fx) * pixel(ix, iy + 1) + fx * pixel(ix + 1, iy + 1));
+			}
+		}
+	}
+
+	void Augmenter::blur(double* field, double* tmp) const
+	{
+		int32_t const radius = static_cast<int32_t>(m_kernel.size() / 2);
+		if (radius == 0)
+		{
+			return;
+		}
+
+		// Separable gaussian, rows then columns, zero outside of the image
+		for (int32_t y = 0; y < size; ++y)
+		{
+			for (int32_t x = 0; x < size; ++x)
+			{
+				double s = 0.0;
+				for (int32_t k = std::max(-radius, -x); k <= std::min(radius, size - 1 - x); ++k)
+				{
+					s += m_kernel[k + radius] * field[y * size + x + k];
+				}
+				tmp[y * size + x] = s;
+			}
+		}
+		for (int32_t y = 0; y < size; ++y)
+		{
+			for (int32_t x = 0; x < size; ++x)
+			{
+				double s = 0.0;
+				for (int32_t k = std::max(-radius, -y); k <= std::min(radius, size - 1 - y); ++k)
+				{
+					s += m_kernel[k + radius] * tmp[(y + k) * size + x];
+				}
+				field[y * size + x] = s;
+			}
+		}
+	}
+
+	std::unique_ptr<Augmenter> Augmenter::deserialize(std::string_view s, int32_t numInputs)
+	{
+		if (s.empty() || s == "none")
+		{
+			return nullptr;
+		}
+
+		int32_t const size = static_cast<int32_t>(std::lround(std::sqrt(numInputs)));
+		if (size * size != numInputs)
+		{
+			throw std::runtime_error(std::format("Augmentation needs square images, got {} inputs", numInputs));
+		}
+
+		double maxShift = 0.0;
+		double maxRotation = 0.0;
+		double elasticAlpha = 0.0;
+		double elasticSigma = 0.0;
+
+		// Comma separated list, commas between parentheses excluded
+		std::size_t begin = 0;
+		int32_t depth = 0;
+		for (std::size_t i = 0; i <= s.size(); ++i)
+		{
+			if (i < s.size() && s[i] == '(')
+			{
+				++depth;
+			}
+			else if (i < s.size() && s[i] == ')')
+			{
+				--depth;
+			}
+			else if (i == s.size() || (s[i] == ',' && depth == 0))
+			{
+				std::string_view const item = s.substr(begin, i - begin);
+				std::string_view const name = item.substr(0, item.find('('));
+				std::vector<double> const parameters = parseParameters(item, "augmentation");
+				if (name == "shift")
+				{
+					maxShift = parameters.size() > 0 ? parameters[0] : 2.0;
+				}
+				else if (name == "rotate")
+				{
+					maxRotation = parameters.size() > 0 ? parameters[0] : 15.0;
+				}
+				else if (name == "elastic")
+				{
+					elasticAlpha = parameters.size() > 0 ? parameters[0] : 8.0;
+					elasticSigma = parameters.size() > 1 ? parameters[1] : 3.0;
+				}
+				else
+				{
+					throw std::runtime_error(std::format("Unknown augmentation `{}`", item));
+				}
+				begin = i + 1;
+			}
+		}
+
+		return std::make_unique<Augmenter>(size, maxShift, maxRotation, elasticAlpha, elasticSigma);
+	}
+
+	std::string Augmenter::serialize() const
+	{
+		std::vector<std::string> items;
+		if (maxShift > 0.0)
+		{
+			items.push_back(std::format("shift({})", maxShift));
+		}
+		if (maxRotation > 0.0)
+		{
+			items.push_back(std::format("rotate({})", maxRotation));
+		}
+		if (elasticAlpha > 0.0)
+		{
+			items.push_back(std::format("elastic({},{})", elasticAlpha, elasticSigma));
+		}
+
+		std::string s;
+		for (const std::string& item : items)
+		{
+			s += (s.empty() ? "" : ",") + item;
+		}
+		return s.empty() ? "none" : s;
+	}
+
+	AugmentationPipeline::AugmentationPipeline(std::unique_ptr<Augmenter> augmenter, int32_t numThreads, std::size_t capacity)
+		: m_augmenter(std::move(augmenter))
+		, m_slots(std::max<std::size_t>(capacity, 1))
+	{
+		std::size_t const numInputs = static_cast<std::size_t>(m_augmenter->size) * m_augmenter->size;
+		std::size_t bytes = 0;
+		for (Slot& slot : m_slots)
+		{
+			slot.entries.resize(ChunkSize);
+			slot.chunk = std::numeric_limits<std::size_t>::max();
+			for (TrainingEntry& entry : slot.entries)
+			{
+				entry.m_inputs.resize(numInputs);
+				bytes += numInputs * sizeof(double);
+			}
+		}
+		m_memory.update(bytes);
+
+		for (int32_t i = 0; i < std::max(numThreads, 1); ++i)
+		{
+			m_workers.emplace_back(&AugmentationPipeline::work, this);
+		}
+	}
+
+	AugmentationPipeline::~AugmentationPipeline()
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			m_stop = true;
+		}
+		m_workAvailable.notify_all();
+		for (std::thread& worker : m_workers)
+		{
+			worker.join();
+		}
+	}
+
+	void AugmentationPipeline::start(const TrainingSet& trainingSet, uint64_t epoch)
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			assert(m_nextChunk == m_consumedChunks && "previous epoch was not fully consumed");
+			m_trainingSet = &trainingSet;
+			m_epoch = epoch;
+			m_numChunks = (trainingSet.size() + ChunkSize - 1) / ChunkSize;
+			m_nextChunk = 0;
+			m_consumedChunks = 0;
+			for (Slot& slot : m_slots)
+			{
+				slot.chunk = std::numeric_limits<std::size_t>::max();
+			}
+		}
+		m_currentSlot = nullptr;
+		m_position = 0;
+		m_workAvailable.notify_all();
+	}
+
+	const TrainingEntry* AugmentationPipeline::next()
+	{
+		if (m_currentSlot != nullptr && m_position < m_currentSlot->count)
+		{
+			return &m_currentSlot->entries[m_position++];
+		}
+
+		std::unique_lock lock(m_mutex);
+		if (m_currentSlot != nullptr)
+		{
+			// Hand the slot back to the workers
+			++m_consumedChunks;
+			m_currentSlot = nullptr;
+			m_workAvailable.notify_all();
+		}
+		if (m_consumedChunks == m_numChunks)
+		{
+			return nullptr;
+		}
+
+		Slot const& slot = m_slots[m_consumedChunks % m_slots.size()];
+		m_chunkReady.wait(lock, [&] { return slot.chunk == m_consumedChunks; });
+		m_currentSlot = &slot;
+		m_position = 0;
+		return &m_currentSlot->entries[m_position++];
+	}
+
+	void AugmentationPipeline::work()
+	{
+		for (;;)
+		{
+			std::unique_lock lock(m_mutex);
+			m_workAvailable.wait(lock, [&] {
+				return m_stop || (m_nextChunk < m_numChunks && m_nextChunk < m_consumedChunks + m_slots.size());
+			});
+			if (m_stop)
+			{
+				return;
+			}
+
+			std::size_t const chunk = m_nextChunk++;
+			Slot& slot = m_slots[chunk % m_slots.size()];
+			const TrainingSet& trainingSet = *m_trainingSet;
+			uint64_t const epoch = m_epoch;
+			lock.unlock();
+
+			fill(slot, chunk, trainingSet, epoch);
+
+			lock.lock();
+			slot.chunk = chunk;
+			lock.unlock();
+			m_chunkReady.notify_one();
+		}
+	}
+
+	void AugmentationPipeline::fill(Slot& slot, std::size_t chunk, const TrainingSet& trainingSet, uint64_t epoch) const
+	{
+		std::size_t const begin = chunk * ChunkSize;
+		std::size_t const end = std::min(begin + ChunkSize, trainingSet.size());
+		slot.count = end - begin;
+		for (std::size_t index = begin; index < end; ++index)
+		{
+			TrainingEntry const& source = trainingSet[index];
+			TrainingEntry& entry = slot.entries[index - begin];
+			std::mt19937_64 rng(sampleSeed(epoch, index));
+			m_augmenter->augment(source.m_inputs.data(), entry.m_inputs.data(), rng);
+			entry.m_expectedOutputs = source.m_expectedOutputs;
+		}
+	}
+}
@@ -0,0 +1,150 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+// On-the-fly data augmentation of square images (random shifts, rotations
+// and elastic distortions), computed by worker threads while the network
+// trains on the previous samples.
+
+#pragma once
+
+#include "MemoryTracker.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace bpn
+{
+	struct TrainingEntry;
+	typedef std::vector<TrainingEntry> TrainingSet;
+
+	class Augmenter
+	{
+		/**
+		 * Every output pixel (x, y) is sampled, with bilinear interpolation,
+		 * at the input position
+		 *
+		 *     R(theta) * (x - c, y - c) + c - (dx, dy) + alpha * (ex(x,y), ey(x,y))
+		 *
+		 * where c is the center of the image, theta is uniform in
+		 * [-maxRotation, maxRotation] degrees, dx and dy are uniform in
+		 * [-maxShift, maxShift] pixels and ex, ey are uniform random fields
+		 * in [-1, 1] smoothed by a gaussian of standard deviation sigma
+		 * (Simard et al., 2003). Pixels sampled outside of the image are 0.
+		 */
+	public:
+		Augmenter(int32_t size, double maxShift, double maxRotation, double elasticAlpha, double elasticSigma);
+
+		/**
+		 * Writes in ``out`` a random distortion of the ``size`` x ``size``
+		 * image ``in``. Thread safe, all the randomness comes from ``rng``.
+		 */
+		void augment(const double* in, double* out, std::mt19937_64& rng) const;
+
+		/**
+		 * Builds an augmenter for images of ``numInputs`` pixels from a comma
+		 * separated list of distortions, for instance
+		 * ``shift(2),rotate(15),elastic(8,3)``. Returns nullptr for ``none``
+		 * or an empty string.
+		 */
+		static std::unique_ptr<Augmenter> deserialize(std::string_view s, int32_t numInputs);
+
+		/**
+		 * Representation of the augmenter as text.
+		 */
+		std::string serialize() const;
+
+		const int32_t size;
+		const double  maxShift;
+		const double  maxRotation;    // degrees
+		const double  elasticAlpha;
+		const double  elasticSigma;
+
+	private:
+		// Smooths ``field`` in place with m_kernel, ``tmp`` has the same size
+		void blur(double* field, double* tmp) const;
+
+		std::vector<double> m_kernel; // normalized gaussian, radius = m_kernel.size() / 2
+	};
+
+	/**
+	 * Bounded queue of augmented training entries. Worker threads augment
+	 * the training set chunk by chunk, at most ``capacity`` chunks ahead of
+	 * the consumer, which receives the entries in the training set order.
+	 *
+	 * The distortions of a sample only depend on the epoch and on the
+	 * index of the sample, not on the number of threads or their
+	 * scheduling, so that training runs are reproducible.
+	 */
+	class AugmentationPipeline
+	{
+	public:
+		static constexpr std::size_t ChunkSize = 64;
+
+		AugmentationPipeline(std::unique_ptr<Augmenter> augmenter, int32_t numThreads, std::size_t capacity);
+		~AugmentationPipeline();
+
+		AugmentationPipeline(const AugmentationPipeline&) = delete;
+		AugmentationPipeline& operator=(const AugmentationPipeline&) = delete;
+
+		/**
+		 * Starts the augmentation of ``trainingSet`` for ``epoch``. The
+		 * previous epoch must have been fully consumed.
+		 */
+		void start(const TrainingSet& trainingSet, uint64_t epoch);
+
+		/**
+		 * Next augmented entry of the epoch, nullptr once every entry was
+		 * returned. The entry stays valid until the next call.
+		 */
+		const TrainingEntry* next();
+
+		inline const Augmenter& augmenter() const
+		{
+			return *m_augmenter;
+		}
+
+		inline int32_t numThreads() const
+		{
+			return static_cast<int32_t>(m_workers.size());
+		}
+
+	private:
+		struct Slot
+		{
+			std::vector<TrainingEntry> entries;
+			std::size_t                count = 0;
+			std::size_t                chunk;   // chunk held by the slot when ready
+		};
+
+		void work();
+		void fill(Slot& slot, std::size_t chunk, const TrainingSet& trainingSet, uint64_t epoch) const;
+
+		std::unique_ptr<Augmenter>  m_augmenter;
+		std::vector<Slot>           m_slots;         // chunk k goes in m_slots[k % capacity]
+		std::vector<std::thread>    m_workers;
+
+		std::mutex                  m_mutex;
+		std::condition_variable     m_workAvailable; // a chunk can be claimed, or stop
+		std::condition_variable     m_chunkReady;    // a worker filled a slot
+		const TrainingSet*          m_trainingSet = nullptr;
+		uint64_t                    m_epoch = 0;
+		std::size_t                 m_numChunks = 0;
+		std::size_t                 m_nextChunk = 0;     // next chunk to claim by a worker
+		std::size_t                 m_consumedChunks = 0;
+		bool                        m_stop = false;
+
+		// Consumer side, only used by the thread calling ``next``
+		const Slot*                 m_currentSlot = nullptr;
+		std::size_t                 m_position = 0;
+
+		MemoryTracker::Registration m_memory{ MemoryTracker::Category::scratch };
+	};
+}
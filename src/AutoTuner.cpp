@@ -0,0 +1,276 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+
+#include "AutoTuner.h"
+#include "AtomicFile.h"
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace bpn
+{
+	namespace
+	{
+		using Clock = std::chrono::steady_clock;
+
+		// Shortest of a few runs of ``f``, in seconds
+		template<typename F>
+		double bestTime(F f)
+		{
+			double best = std::numeric_limits<double>::infinity();
+			for (int run = 0; run < 3; ++run)
+			{
+				auto const start = Clock::now();
+				f();
+				best = std::min(best, std::chrono::duration<double>(Clock::now() - start).count());
+			}
+			return best;
+		}
+
+		// Powers of two from ``first`` below ``max``, followed by ``max`` itself
+		std::vector<std::size_t> powersOfTwo(std::size_t first, std::size_t max)
+		{
+			std::vector<std::size_t> candidates;
+			for (std::size_t candidate = first; candidate < max; candidate *= 2)
+			{
+				candidates.push_back(candidate);
+			}
+			candidates.push_back(max);
+			return candidates;
+		}
+	}
+
+	Tuning AutoTuner::tune(Network const& network, TrainingSet const& trainingSet, NetworkTrainer::Settings const& settings,
+		int32_t maxThreads, std::size_t minLayerWeights)
+	{
+		auto const start = Clock::now();
+		bool const pipelined = settings.m_useBatchLearning && settings.m_pipelineStages > 1;
+
+		std::ostringstream key;
+		key << hostName() << "; layers=";
+		for (std::size_t i = 0; i < network.getLayerSizes().size(); ++i)
+		{
+			key << (i > 0 ? "," : "") << network.getLayerSizes()[i];
+		}
+		key << "; stages=" << (pipelined ? settings.m_pipelineStages : 1) << "; threads=" << maxThreads
+			<< "; minWeights=" << minLayerWeights;
+
+		Tuning tuning;
+		tuning.pipelineMicroBatch = settings.m_pipelineMicroBatch;
+		m_cached = load(key.str(), tuning);
+		m_saveError.clear();
+		if (!m_cached && !trainingSet.empty())
+		{
+			Network copy(network);
+			tuning.batchTiling = tuneBatchTiling(copy, trainingSet);
+			tuning.intraLayerThreads = tuneIntraLayerThreads(copy, trainingSet, maxThreads, minLayerWeights);
+			if (pipelined)
+			{
+				copy.setBatchTiling(tuning.batchTiling);
+				copy.setIntraLayerThreads(1);
+				tuning.pipelineMicroBatch = tunePipelineMicroBatch(copy, trainingSet, settings);
+			}
+			// Without the cache, the next runs measure again
+			try
+			{
+				save(key.str(), tuning);
+			}
+			catch (const std::exception& e)
+			{
+				m_saveError = e.what();
+			}
+		}
+
+		m_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		return tuning;
+	}
+
+	std::string AutoTuner::hostName()
+	{
+		std::string model = "unknown CPU";
+		std::ifstream cpuinfo("/proc/cpuinfo");
+		for (std::string line; std::getline(cpuinfo, line); )
+		{
+			if (line.starts_with("model name"))
+			{
+				std::size_t const colon = line.find(':');
+				if (colon != std::string::npos && colon + 2 <= line.size())
+				{
+					model = line.substr(colon + 2);
+				}
+				break;
+			}
+		}
+		return std::format("{} x{}", model, std::max(1u, std::thread::hardware_concurrency()));
+	}
+
+	std::size_t AutoTuner::measuredSamples(Network const& network, TrainingSet const& trainingSet, std::size_t maxSamples)
+	{
+		std::size_t numWeights = 0;
+		for (int32_t layer = 0; layer + 1 < network.getNumLayers(); ++layer)
+		{
+			numWeights += network.getWeights(layer).size();
+		}
+		std::size_t const numSamples = std::clamp(MeasuredWeights / std::max<std::size_t>(numWeights, 1), MinSamples, maxSamples);
+		return std::min(numSamples, trainingSet.size());
+	}
+
+	kernels::BatchTiling AutoTuner::tuneBatchTiling(Network& network, TrainingSet const& trainingSet)
+	{
+		std::size_t const numSamples = measuredSamples(network, trainingSet, MaxKernelSamples);
+		Matrix inputs(static_cast<int>(numSamples), network.getNumInputs());
+		Matrix outputs(static_cast<int>(numSamples), network.getNumOutputs());
+		for (std::size_t b = 0; b < numSamples; ++b)
+		{
+			std::ranges::copy(trainingSet[b].m_inputs, inputs.data() + b * network.getNumInputs());
+		}
+
+		// Widest output among the layers of weights
+		std::vector<int> const& layerSizes = network.getLayerSizes();
+		std::size_t const maxColumns = *std::max_element(layerSizes.begin() + 1, layerSizes.end());
+
+		kernels::BatchTiling best = network.getBatchTiling();
+		double bestSeconds = std::numeric_limits<double>::infinity();
+		for (std::size_t samples : powersOfTwo(1, numSamples))
+		{
+			for (std::size_t columns : powersOfTwo(64, maxColumns))
+			{
+				network.setBatchTiling({ samples, columns });
+				double const seconds = bestTime([&]() { network.EvaluateBatch(inputs, outputs); });
+				if (seconds < bestSeconds)
+				{
+					best = { samples, columns };
+					bestSeconds = seconds;
+				}
+			}
+		}
+		network.setBatchTiling(best);
+		return best;
+	}
+
+	int32_t AutoTuner::tuneIntraLayerThreads(Network& network, TrainingSet const& trainingSet, int32_t maxThreads,
+		std::size_t minLayerWeights)
+	{
+		// Threads only split the layers with enough weights
+		bool splitLayers = false;
+		for (int32_t layer = 0; layer + 1 < network.getNumLayers(); ++layer)
+		{
+			splitLayers = splitLayers || network.getWeights(layer).size() >= minLayerWeights;
+		}
+		if (!splitLayers || maxThreads <= 1)
+		{
+			return 1;
+		}
+
+		std::size_t const numSamples = measuredSamples(network, trainingSet, MaxKernelSamples);
+		int32_t best = 1;
+		double bestSeconds = std::numeric_limits<double>::infinity();
+		for (std::size_t numThreads : powersOfTwo(1, static_cast<std::size_t>(maxThreads)))
+		{
+			network.setIntraLayerThreads(static_cast<int32_t>(numThreads), minLayerWeights);
+			double const seconds = bestTime([&]()
+			{
+				for (std::size_t sample = 0; sample < numSamples; ++sample)
+				{
+					network.Evaluate(trainingSet[sample].m_inputs);
+				}
+			});
+			// More threads must be worth the cores they take
+			if (seconds < 0.95 * bestSeconds)
+			{
+				best = network.getIntraLayerThreads();
+				bestSeconds = seconds;
+			}
+		}
+		network.setIntraLayerThreads(1);
+		return best;
+	}
+
+	int32_t AutoTuner::tunePipelineMicroBatch(Network const& network, TrainingSet const& trainingSet,
+		NetworkTrainer::Settings const& settings)
+	{
+		TrainingSet const samples(trainingSet.begin(),
+			trainingSet.begin() + measuredSamples(network, trainingSet, MaxPipelineSamples));
+
+		NetworkTrainer::Settings candidateSettings = settings;
+		candidateSettings.m_augmentation = "none";
+		candidateSettings.m_verbosity = 0;
+
+		int32_t best = settings.m_pipelineMicroBatch;
+		double bestThroughput = 0.0;
+		for (std::size_t microBatch : powersOfTwo(1, std::min<std::size_t>(64, samples.size())))
+		{
+			// Trained on a fresh copy, one epoch to warm up and one measured
+			Network copy(network);
+			candidateSettings.m_pipelineMicroBatch = static_cast<int32_t>(microBatch);
+			NetworkTrainer trainer(candidateSettings, &copy);
+			trainer.Benchmark(samples, 1);
+			double const throughput = trainer.Benchmark(samples, 1);
+			if (throughput > bestThroughput)
+			{
+				best = static_cast<int32_t>(microBatch);
+				bestThroughput = throughput;
+			}
+		}
+		return best;
+	}
+
+	bool AutoTuner::load(std::string const& key, Tuning& tuning) const
+	{
+		std::ifstream file(m_cachePath);
+		for (std::string line; std::getline(file, line); )
+		{
+			std::size_t const tab = line.find('\t');
+			if (tab == std::string::npos || std::string_view(line).substr(0, tab) != key)
+			{
+				continue;
+			}
+
+			std::istringstream values(line.substr(tab + 1));
+			Tuning cached;
+			values >> cached.batchTiling.samples >> cached.batchTiling.columns
+				>> cached.intraLayerThreads >> cached.pipelineMicroBatch;
+			if (!values.fail() && cached.batchTiling.samples > 0 && cached.batchTiling.columns > 0
+				&& cached.intraLayerThreads > 0 && cached.pipelineMicroBatch > 0)
+			{
+				tuning = cached;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void AutoTuner::save(std::string const& key, Tuning const& tuning) const
+	{
+		// The entries of the other hosts and networks are kept
+		std::vector<std::string> lines;
+		{
+			std::ifstream file(m_cachePath);
+			for (std::string line; std::getline(file, line); )
+			{
+				if (!line.empty() && !line.starts_with(key + '\t'))
+				{
+					lines.push_back(line);
+				}
+			}
+		}
+		lines.push_back(std::format("{}\t{} {} {} {}", key, tuning.batchTiling.samples, tuning.batchTiling.columns,
+			tuning.intraLayerThreads, tuning.pipelineMicroBatch));
+
+		writeFileAtomically(m_cachePath, [&](std::ostream& file)
+		{
+			for (std::string const& line : lines)
+			{
+				file << line << '\n';
+			}
+		});
+	}
+}
@@ -0,0 +1,91 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+// Startup auto-tuning : the block sizes of the batch kernel, the threads of
+// a single evaluation and the pipeline micro-batch are measured on the
+// actual network, and remembered in a cache file keyed by the host CPU and
+// the layer sizes.
+
+#pragma once
+
+#include "Kernels.h"
+#include "NeuralNetworkTrainer.h"
+#include <cstdint>
+#include <string>
+
+namespace bpn
+{
+	// Speed settings chosen by the AutoTuner, none of them changes the results
+	struct Tuning
+	{
+		kernels::BatchTiling batchTiling;
+		int32_t              intraLayerThreads = 1;
+		int32_t              pipelineMicroBatch = 8;
+	};
+
+	class AutoTuner
+	{
+		// Weights times samples of each measurement, which keeps the whole
+		// tuning within a fraction of a second whatever the network
+		static constexpr std::size_t MeasuredWeights = 1 << 22;
+		// Bounds of the samples of each measurement
+		static constexpr std::size_t MinSamples = 8;
+		static constexpr std::size_t MaxKernelSamples = 64;
+		static constexpr std::size_t MaxPipelineSamples = 512;
+
+	public:
+		explicit AutoTuner(std::string cachePath)
+			: m_cachePath{ std::move(cachePath) }
+		{ }
+
+		/**
+		 * Tuning of ``network`` trained with ``settings`` on this host, read
+		 * from the cache or measured on copies of the network and of the
+		 * first training samples, then saved. ``maxThreads`` bounds the
+		 * threads of an evaluation, layers with fewer than
+		 * ``minLayerWeights`` weights being evaluated on one thread.
+		 */
+		Tuning tune(Network const& network, TrainingSet const& trainingSet, NetworkTrainer::Settings const& settings,
+			int32_t maxThreads, std::size_t minLayerWeights);
+
+		// Whether the last ``tune`` was read from the cache
+		inline bool wasCached() const
+		{
+			return m_cached;
+		}
+
+		// Why the tuning measured by the last ``tune`` was not saved, empty if it was
+		inline std::string const& getSaveError() const
+		{
+			return m_saveError;
+		}
+
+		// Duration of the last ``tune``
+		inline double getSeconds() const
+		{
+			return m_seconds;
+		}
+
+		// CPU model and number of cores of this host
+		static std::string hostName();
+
+	private:
+		// Samples of a measurement on ``network``, within [MinSamples, maxSamples]
+		static std::size_t measuredSamples(Network const& network, TrainingSet const& trainingSet, std::size_t maxSamples);
+
+		static kernels::BatchTiling tuneBatchTiling(Network& network, TrainingSet const& trainingSet);
+		static int32_t tuneIntraLayerThreads(Network& network, TrainingSet const& trainingSet, int32_t maxThreads,
+			std::size_t minLayerWeights);
+		static int32_t tunePipelineMicroBatch(Network const& network, TrainingSet const& trainingSet,
+			NetworkTrainer::Settings const& settings);
+
+		bool load(std::string const& key, Tuning& tuning) const;
+		void save(std::string const& key, Tuning const& tuning) const;
+
+		std::string m_cachePath;
+		bool        m_cached = false;
+		std::string m_saveError;
+		double      m_seconds = 0.0;
+	};
+}
@@ -0,0 +1,90 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+// Inference benchmark of the code generated ahead of time by generateBPN
+// against the generic Network::Evaluate, on the same network and inputs.
+// BPN_BENCHMARK_MODEL is the model file matching the generated header
+// benchmark_network.h.
+
+#include "NeuralNetwork.h"
+#include "vectorstream.h"
+#include "benchmark_network.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+using bpn::operator<<;
+
+int main()
+{
+	std::ifstream is(BPN_BENCHMARK_MODEL);
+	if (!is.good())
+	{
+		std::cerr << "Error: unable to read `" << BPN_BENCHMARK_MODEL << "`" << std::endl;
+		return 1;
+	}
+	bpn::Network network(is);
+
+	// Inputs shaped like MNIST images : about 80% of zeros
+	constexpr std::size_t numSamples = 2000;
+	constexpr int numRounds = 5;
+	std::mt19937 generator(0);
+	std::uniform_real_distribution<double> pixel(0.0, 1.0);
+	std::vector<std::vector<double>> inputs(numSamples, std::vector<double>(benchmark_network::numInputs));
+	for (std::vector<double>& input : inputs)
+	{
+		for (double& x : input)
+		{
+			x = pixel(generator) < 0.8 ? 0.0 : pixel(generator);
+		}
+	}
+
+	using Clock = std::chrono::steady_clock;
+	double checksum = 0.0;
+	double largestDifference = 0.0;
+	double evaluateSeconds = std::numeric_limits<double>::infinity();
+	double generatedSeconds = std::numeric_limits<double>::infinity();
+	std::vector<double> output(benchmark_network::numOutputs);
+	for (int round = 0; round < numRounds; ++round)
+	{
+		auto const start = Clock::now();
+		for (const std::vector<double>& input : inputs)
+		{
+			network.Evaluate(input);
+			checksum += network.getValue(network.getNumLayers() - 1, 0);
+		}
+		auto const middle = Clock::now();
+		for (const std::vector<double>& input : inputs)
+		{
+			benchmark_network::infer(input.data(), output.data());
+			checksum += output[0];
+		}
+		auto const end = Clock::now();
+		evaluateSeconds = std::min(evaluateSeconds, std::chrono::duration<double>(middle - start).count());
+		generatedSeconds = std::min(generatedSeconds, std::chrono::duration<double>(end - middle).count());
+	}
+
+	for (const std::vector<double>& input : inputs)
+	{
+		network.Evaluate(input);
+		benchmark_network::infer(input.data(), output.data());
+		for (std::size_t k = 0; k < benchmark_network::numOutputs; ++k)
+		{
+			largestDifference = std::max(largestDifference,
+				std::abs(output[k] - network.getValue(network.getNumLayers() - 1, static_cast<int>(k))));
+		}
+	}
+
+	std::cout << "Network: " << network.getLayerSizes() << ", " << network.activationFunctionName() << std::endl
+		<< " Network::Evaluate: " << evaluateSeconds / numSamples * 1e6 << " us per sample" << std::endl
+		<< " Generated infer:   " << generatedSeconds / numSamples * 1e6 << " us per sample" << std::endl
+		<< " Speedup: " << evaluateSeconds / generatedSeconds << "x" << std::endl
+		<< " Largest output difference: " << largestDifference << " (checksum " << checksum << ")" << std::endl;
+	return largestDifference <= 1e-12 ? 0 : 1;
+}
@@ -0,0 +1,144 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+
+#include "CodeGenerator.h"
+#include "vectorstream.h"
+#include <sstream>
+
+namespace bpn
+{
+	std::string generateHeader(const Network& network, std::string_view namespaceName)
+	{
+		std::vector<int> const& layerSizes = network.getLayerSizes();
+		int32_t const numLayers = network.getNumLayers();
+
+		std::stringstream ss;
+		ss << "// Generated from a trained network, do not edit.\n"
+			<< "// Layers: " << layerSizes << ", activation: " << network.activationFunctionName()
+			<< ", output: " << (network.hasSoftmaxOutput() ? "Softmax" : "activation") << "\n"
+			<< "\n"
+			<< "#pragma once\n"
+			<< "\n"
+			<< "#include <algorithm>\n"
+			<< "#include <cmath>\n"
+			<< "#include <cstddef>\n"
+			<< "\n"
+			<< "namespace " << namespaceName << "\n"
+			<< "{\n"
+			<< "\tconstexpr std::size_t numLayers = " << numLayers << ";\n"
+			<< "\tconstexpr std::size_t layerSizes[numLayers] = { ";
+		for (int32_t i = 0; i < numLayers; ++i)
+		{
+			ss << (i > 0 ? ", " : "") << layerSizes[i];
+		}
+		ss << " };\n"
+			<< "\tconstexpr std::size_t numInputs = " << network.getNumInputs() << ";\n"
+			<< "\tconstexpr std::size_t numOutputs = " << network.getNumOutputs() << ";\n";
+
+		// weights<i>[j * size(i+1) + k] is the weight from neuron j of layer
+		// i to neuron k of layer i+1, the last row being the bias neuron
+		ss << std::hexfloat;
+		for (int32_t i = 0; i < numLayers - 1; ++i)
+		{
+			Matrix const& weights = network.getWeights(i);
+			ss << "\n"
+				<< "\t// Weights from layer " << i << " to layer " << i + 1 << ", row " << layerSizes[i]
+				<< " is the bias neuron\n"
+				<< "\talignas(64) inline constexpr double weights" << i << "[" << weights.size() << "] = {";
+			for (std::size_t w = 0; w < weights.size(); ++w)
+			{
+				ss << (w % 8 == 0 ? "\n\t\t" : " ") << weights.data()[w] << ",";
+			}
+			ss << "\n\t};\n";
+		}
+		ss << std::defaultfloat;
+
+		// Same order of the operations as Network::Evaluate
+		ss << "\n"
+			<< "\tnamespace detail\n"
+			<< "\t{\n"
+			<< "\t\t// y = x * W, plus the bias row of W\n"
+			<< "\t\ttemplate<std::size_t Rows, std::size_t Cols>\n"
+			<< "\t\tinline void layer(const double* __restrict W, const double* __restrict x, double* __restrict y)\n"
+			<< "\t\t{\n"
+			<< "\t\t\tfor (std::size_t k = 0; k < Cols; ++k)\n"
+			<< "\t\t\t{\n"
+			<< "\t\t\t\ty[k] = 0.0;\n"
+			<< "\t\t\t}\n"
+			<< "\t\t\tfor (std::size_t r = 0; r < Rows; ++r)\n"
+			<< "\t\t\t{\n"
+			<< "\t\t\t\tdouble const xr = x[r];\n"
+			<< "\t\t\t\tif (xr == 0.0)\n"
+			<< "\t\t\t\t{\n"
+			<< "\t\t\t\t\tcontinue;\n"
+			<< "\t\t\t\t}\n"
+			<< "\t\t\t\tconst double* __restrict row = W + r * Cols;\n"
+			<< "\t\t\t\tfor (std::size_t k = 0; k < Cols; ++k)\n"
+			<< "\t\t\t\t{\n"
+			<< "\t\t\t\t\ty[k] += xr * row[k];\n"
+			<< "\t\t\t\t}\n"
+			<< "\t\t\t}\n"
+			<< "\t\t\tfor (std::size_t k = 0; k < Cols; ++k)\n"
+			<< "\t\t\t{\n"
+			<< "\t\t\t\ty[k] += W[Rows * Cols + k];\n"
+			<< "\t\t\t}\n"
+			<< "\t\t}\n"
+			<< "\t}\n"
+			<< "\n"
+			<< "\t// Output values of the network for ``input`` (numInputs values)\n"
+			<< "\tinline void infer(const double* __restrict input, double* __restrict output)\n"
+			<< "\t{\n";
+
+		for (int32_t i = 1; i < numLayers; ++i)
+		{
+			bool const outputLayer = i == numLayers - 1;
+			std::string const in = i == 1 ? "input" : "values" + std::to_string(i - 1);
+			std::string const out = outputLayer ? "output" : "values" + std::to_string(i);
+			if (!outputLayer)
+			{
+				ss << "\t\talignas(64) double " << out << "[" << layerSizes[i] << "];\n";
+			}
+			ss << "\t\tdetail::layer<" << layerSizes[i - 1] << ", " << layerSizes[i] << ">(weights" << i - 1
+				<< ", " << in << ", " << out << ");\n";
+			if (!outputLayer || !network.hasSoftmaxOutput())
+			{
+				ss << "\t\tfor (std::size_t k = 0; k < " << layerSizes[i] << "; ++k)\n"
+					<< "\t\t{\n"
+					<< "\t\t\tdouble const x = " << out << "[k];\n"
+					<< "\t\t\t" << out << "[k] = " << network.activationFunction(i).generateCode("x") << ";\n"
+					<< "\t\t}\n";
+			}
+		}
+
+		if (network.hasSoftmaxOutput())
+		{
+			ss << "\n"
+				<< "\t\t// Softmax, shifted by the largest value so that exp() cannot overflow\n"
+				<< "\t\tdouble const largest = *std::max_element(output, output + numOutputs);\n"
+				<< "\t\tdouble sum = 0.0;\n"
+				<< "\t\tfor (std::size_t k = 0; k < numOutputs; ++k)\n"
+				<< "\t\t{\n"
+				<< "\t\t\toutput[k] = std::exp(output[k] - largest);\n"
+				<< "\t\t\tsum += output[k];\n"
+				<< "\t\t}\n"
+				<< "\t\tfor (std::size_t k = 0; k < numOutputs; ++k)\n"
+				<< "\t\t{\n"
+				<< "\t\t\toutput[k] /= sum;\n"
+				<< "\t\t}\n";
+		}
+
+		ss << "\t}\n"
+			<< "\n"
+			<< "\t// Index of the output neuron with the largest value\n"
+			<< "\tinline std::size_t predict(const double* input)\n"
+			<< "\t{\n"
+			<< "\t\tdouble output[numOutputs];\n"
+			<< "\t\tinfer(input, output);\n"
+			<< "\t\treturn std::max_element(output, output + numOutputs) - output;\n"
+			<< "\t}\n"
+			<< "}\n";
+		return ss.str();
+	}
+}
@@ -0,0 +1,32 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+// Ahead-of-time compilation of a trained network : the weights and the
+// inference code are written as a standalone C++ header, with no
+// dependency on this project and no file to parse at run time.
+
+#pragma once
+
+#include "NeuralNetwork.h"
+#include <string>
+#include <string_view>
+
+namespace bpn
+{
+	/**
+	 * Header defining, in namespace ``namespaceName`` :
+	 *
+	 *     constexpr std::size_t numInputs, numOutputs, layerSizes[]
+	 *     alignas(64) constexpr double weights0[], weights1[], ...
+	 *     void infer(const double* input, double* output)
+	 *     std::size_t predict(const double* input)
+	 *
+	 * ``infer`` is specialized for the layer sizes and the activation
+	 * functions of ``network`` : every loop has a compile time trip count,
+	 * the activation functions are inlined, and it computes the same output
+	 * values as ``Network::Evaluate`` with dense weights. The weights are
+	 * written as hexadecimal floating point literals, so they are exact.
+	 */
+	std::string generateHeader(const Network& network, std::string_view namespaceName);
+}
@@ -0,0 +1,201 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+
+#include "DataParallel.h"
+#include "Arena.h"
+#include "NeuralNetworkTrainer.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#if defined(__unix__)
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace bpn
+{
+	void Communicator::barrier()
+	{
+		if (m_size == 1)
+		{
+			return;
+		}
+
+		// Sense reversing barrier : the last process to arrive opens it
+		uint32_t const generation = m_header->generation.load(std::memory_order_acquire);
+		if (m_header->arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == static_cast<uint32_t>(m_size))
+		{
+			m_header->arrived.store(0, std::memory_order_relaxed);
+			m_header->generation.fetch_add(1, std::memory_order_release);
+			return;
+		}
+
+		for (uint32_t spins = 0; m_header->generation.load(std::memory_order_acquire) == generation; ++spins)
+		{
+			if (m_header->aborted.load(std::memory_order_relaxed) != 0)
+			{
+				throw std::runtime_error("Another training process failed");
+			}
+			if (spins >= 64)
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	void Communicator::allReduceSum(std::size_t n)
+	{
+		assert(n <= m_bufferSize);
+		if (m_size == 1)
+		{
+			return;
+		}
+
+		// The elements are split in ``size`` chunks, chunk c being
+		// [c * n / size, (c + 1) * n / size)
+		auto chunkRange = [&](int32_t c)
+		{
+			std::size_t const k = static_cast<std::size_t>((c % m_size + m_size) % m_size);
+			return std::pair<std::size_t, std::size_t>(k * n / m_size, (k + 1) * n / m_size);
+		};
+
+		double* const own = buffer(m_rank);
+		const double* const left = buffer(m_rank - 1);
+
+		// Every buffer holds the values of its process
+		barrier();
+
+		// Reduce-scatter : after step s, chunk (rank - 1 - s) of this process
+		// holds the sum over processes rank - 1 - s, ..., rank
+		for (int32_t step = 0; step < m_size - 1; ++step)
+		{
+			auto const [begin, end] = chunkRange(m_rank - 1 - step);
+			for (std::size_t i = begin; i < end; ++i)
+			{
+				own[i] += left[i];
+			}
+			barrier();
+		}
+
+		// All-gather : chunk (rank + 1) is complete, copy the complete chunks
+		// of the left neighbor one by one
+		for (int32_t step = 0; step < m_size - 1; ++step)
+		{
+			auto const [begin, end] = chunkRange(m_rank - step);
+			std::copy(left + begin, left + end, own + begin);
+			barrier();
+		}
+	}
+
+	double Communicator::sum(double value)
+	{
+		buffer()[0] = value;
+		allReduceSum(1);
+		return buffer()[0];
+	}
+
+	void Communicator::abort() noexcept
+	{
+		m_header->aborted.store(1, std::memory_order_relaxed);
+	}
+
+	LaunchResult launchProcesses(int32_t numProcesses, std::size_t bufferSize,
+		const std::function<int(Communicator&)>& worker)
+	{
+#if defined(__unix__)
+		// One cache line aligned header, then the buffers
+		std::size_t const headerBytes = Arena::align(sizeof(Communicator::Header));
+		std::size_t const bytes = headerBytes + Arena::align(bufferSize * sizeof(double)) * numProcesses;
+		void* region = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		if (region == MAP_FAILED)
+		{
+			throw std::runtime_error("Could not map the memory shared by the training processes");
+		}
+		auto* header = new (region) Communicator::Header{};
+		auto* buffers = reinterpret_cast<double*>(static_cast<std::byte*>(region) + headerBytes);
+		std::size_t const stride = Arena::align(bufferSize * sizeof(double)) / sizeof(double);
+
+		// Buffered output would be written once by every process
+		std::cout.flush();
+		std::cerr.flush();
+		std::fflush(nullptr);
+
+		std::vector<pid_t> pids;
+		for (int32_t rank = 0; rank < numProcesses; ++rank)
+		{
+			pid_t const pid = ::fork();
+			if (pid < 0)
+			{
+				header->aborted.store(1);
+				break;
+			}
+			if (pid == 0)
+			{
+				Communicator communicator(header, buffers, stride, rank, numProcesses);
+				int exitCode = 1;
+				try
+				{
+					exitCode = worker(communicator);
+				}
+				catch (const std::exception& e)
+				{
+					std::cerr << "Process " << rank << ": " << e.what() << std::endl;
+				}
+				if (exitCode != 0)
+				{
+					communicator.abort();
+				}
+				std::cout.flush();
+				std::cerr.flush();
+				std::fflush(nullptr);
+				::_exit(exitCode);
+			}
+			pids.push_back(pid);
+		}
+
+		LaunchResult result{ pids.size() == static_cast<std::size_t>(numProcesses) ? 0 : 1, 0.0 };
+		for (std::size_t i = 0; i < pids.size(); ++i)
+		{
+			int status = 0;
+			if (::waitpid(-1, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			{
+				// A crashed process cannot reach the barriers anymore
+				header->aborted.store(1);
+				result.exitCode = 1;
+			}
+		}
+		result.result = header->result;
+		::munmap(region, bytes);
+		return result;
+#else
+		(void)numProcesses;
+		(void)bufferSize;
+		(void)worker;
+		throw std::runtime_error("Multi-process training needs a POSIX system");
+#endif
+	}
+
+	std::size_t keepShard(TrainingSet& trainingSet, int32_t rank, int32_t size)
+	{
+		std::size_t const shardSize = trainingSet.size() / size;
+		std::size_t const leftOut = trainingSet.size() - shardSize * size;
+		TrainingSet shard;
+		shard.reserve(shardSize);
+		for (std::size_t i = 0; i < shardSize; ++i)
+		{
+			shard.push_back(std::move(trainingSet[i * size + rank]));
+		}
+		trainingSet = std::move(shard);
+		return leftOut;
+	}
+}
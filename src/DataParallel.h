@@ -0,0 +1,122 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+// Data parallel training over several processes of the same machine. The
+// processes are forked once the data and the network are ready, each one
+// trains on its own shard of the training set and the gradients are
+// averaged at every weight update with a ring all-reduce over shared
+// memory.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+
+namespace bpn
+{
+	struct TrainingEntry;
+	typedef std::vector<TrainingEntry> TrainingSet;
+
+	class Communicator
+	{
+	public:
+		// Layout of the shared memory region, followed by one buffer per process
+		struct Header
+		{
+			std::atomic<uint32_t> arrived;       // processes waiting in the barrier
+			std::atomic<uint32_t> generation;    // incremented when the barrier opens
+			std::atomic<uint32_t> aborted;       // a process failed, the others must stop
+			double                result;        // value reported by rank 0 to the launcher
+		};
+
+		Communicator(Header* header, double* buffers, std::size_t bufferSize, int32_t rank, int32_t size) noexcept
+			: m_header{ header }
+			, m_buffers{ buffers }
+			, m_bufferSize{ bufferSize }
+			, m_rank{ rank }
+			, m_size{ size }
+		{ }
+
+		inline int32_t rank() const
+		{
+			return m_rank;
+		}
+
+		inline int32_t size() const
+		{
+			return m_size;
+		}
+
+		/**
+		 * Shared buffer of this process. ``allReduceSum`` operates in place on
+		 * the first elements of the buffers of every process.
+		 */
+		inline std::span<double> buffer()
+		{
+			return { m_buffers + m_rank * m_bufferSize, m_bufferSize };
+		}
+
+		// Waits until every process reached the barrier
+		void barrier();
+
+		/**
+		 * Replaces the ``n`` first elements of every buffer by their sum over
+		 * the processes. Ring algorithm : ``size - 1`` reduce-scatter steps,
+		 * then ``size - 1`` all-gather steps, each process reading the chunk
+		 * of its left neighbor. Every process gets exactly the same sums.
+		 */
+		void allReduceSum(std::size_t n);
+
+		// Sum of ``value`` over the processes
+		double sum(double value);
+
+		// Tells the other processes to stop, e.g. after an exception
+		void abort() noexcept;
+
+		// Value returned to the launcher by ``launchProcesses``, rank 0 only
+		inline void setResult(double result)
+		{
+			m_header->result = result;
+		}
+
+	private:
+		double* buffer(int32_t rank)
+		{
+			return m_buffers + ((rank + m_size) % m_size) * m_bufferSize;
+		}
+
+		Header*     m_header;
+		double*     m_buffers;
+		std::size_t m_bufferSize;    // doubles per process
+		int32_t     m_rank;
+		int32_t     m_size;
+	};
+
+	struct LaunchResult
+	{
+		int    exitCode;   // 0 when every process succeeded
+		double result;     // see Communicator::setResult
+	};
+
+	/**
+	 * Forks ``numProcesses`` worker processes sharing buffers of
+	 * ``bufferSize`` doubles, runs ``worker`` in each of them and waits for
+	 * their completion. The calling process only launches and waits, so its
+	 * state is left untouched. POSIX systems only.
+	 */
+	LaunchResult launchProcesses(int32_t numProcesses, std::size_t bufferSize,
+		const std::function<int(Communicator&)>& worker);
+
+	/**
+	 * Keeps the shard of ``trainingSet`` of process ``rank`` among ``size``
+	 * processes, every shard having the same number of entries so that the
+	 * processes do the same number of weight updates. Returns the number of
+	 * entries left out of every shard, the last ``trainingSet.size() % size``.
+	 */
+	std::size_t keepShard(TrainingSet& trainingSet, int32_t rank, int32_t size);
+}
@@ -6,12 +6,25 @@
 //-------------------------------------------------------------------------
 
 #include "DataReader.h"
+#include "AtomicFile.h"
+#include "Random.h"
 #include <assert.h>
 #include <iosfwd>
 #include <algorithm>
 #include <iostream>
 #include <random>
 #include <memory>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+
+#if defined(__unix__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 //-------------------------------------------------------------------------
 
@@ -53,6 +66,28 @@ void textToListOfDouble(std::vector<double>& l, const std::string& s)
 }
 
 
+namespace
+{
+	constexpr char cacheMagic[8] = { 'B', 'P', 'N', 'C', 'A', 'C', 'H', 'E' };
+	constexpr uint32_t cacheVersion = 1;
+
+	// FNV-1a hash of the content of a file
+	uint64_t hashFile(const std::filesystem::path& path)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		std::ifstream file(path, std::ios::in | std::ios::binary);
+		std::vector<char> buffer(1 << 16);
+		while (file.read(buffer.data(), buffer.size()) || file.gcount() > 0)
+		{
+			for (std::streamsize i = 0; i < file.gcount(); ++i)
+			{
+				hash = (hash ^ static_cast<unsigned char>(buffer[i])) * 1099511628211ull;
+			}
+		}
+		return hash;
+	}
+}
+
 namespace bpn
 {
 	DataReader::DataReader(std::string const& filename,
@@ -123,11 +158,14 @@ namespace bpn
 			m_dataStream->read((char*)&nbData, sizeof(int));
 			m_dataStream->read((char*)&nbInputValues, sizeof(int));
 			m_dataStream->read((char*)&nbOutputValues, sizeof(int));
+			entries.reserve(std::max(nbData, 0));
 
 			for (int i = 0; i < nbData; ++i)
 			{
 				entries.push_back(TrainingEntry());
 				TrainingEntry& entry = entries.back();
+				entry.m_inputs.reserve(m_numInputs);
+				entry.m_expectedOutputs.reserve(m_numOutputs);
 
 				for (int i = 0; i < m_numInputs; ++i)
 				{
@@ -156,6 +194,14 @@ namespace bpn
 
 			}
 		}
+		else if (m_dataFormat == bpn::DataReader::Format::numberList && useCache() && ReadCache(entries))
+		{
+			if (m_verbosity >= 1)
+			{
+				std::cout << "Read " << entries.size() << " entries from the cache `"
+					<< cachePath().string() << "`" << std::endl;
+			}
+		}
 		else if (m_dataFormat == bpn::DataReader::Format::numberList)
 		{
 			while (!m_dataStream->eof())
@@ -168,6 +214,8 @@ namespace bpn
 
 				entries.push_back(TrainingEntry());
 				TrainingEntry& entry = entries.back();
+				entry.m_inputs.reserve(m_numInputs);
+				entry.m_expectedOutputs.reserve(m_numOutputs);
 
 				std::stringstream ss;
 				insertListInStream(ss, line, ",");
@@ -194,6 +242,10 @@ namespace bpn
 				assert(entry.m_expectedOutputs.size() == (uint32_t)m_numOutputs);
 			}
 
+			if (useCache() && !entries.empty())
+			{
+				WriteCache(entries);
+			}
 		}
 		if (!entries.empty())
 		{
@@ -205,12 +257,210 @@ namespace bpn
 
 
 
+	std::size_t DataReader::plannedFootprint() const
+	{
+		return plannedEntries() * entryFootprint(m_numInputs, m_numOutputs);
+	}
+
+	std::size_t DataReader::plannedEntries() const
+	{
+		if (m_filename.compare("-") == 0)
+		{
+			return 0;
+		}
+
+		std::size_t numEntries = 0;
+		if (m_dataFormat == Format::binary)
+		{
+			std::ifstream file(m_filename, std::ios::in | std::ios::binary);
+			int nbData = 0;
+			file.read((char*)&nbData, sizeof(int));
+			numEntries = file ? std::max(nbData, 0) : 0;
+		}
+		else if (CacheHeader header; useCache()
+			&& std::ifstream(cachePath(), std::ios::in | std::ios::binary).read((char*)&header, sizeof(header))
+			&& ValidCacheHeader(header))
+		{
+			numEntries = header.numEntries;
+		}
+		else
+		{
+			std::ifstream file(m_filename, std::ios::in);
+			std::string line;
+			while (std::getline(file, line))
+			{
+				if (!line.empty() && line[0] != '#')
+				{
+					++numEntries;
+				}
+			}
+		}
+		return numEntries;
+	}
+
+	DataReader::Format DataReader::parseFormat(std::string_view s)
+	{
+		if (s == "binary")
+		{
+			return Format::binary;
+		}
+		if (s == "numberList")
+		{
+			return Format::numberList;
+		}
+		throw std::runtime_error(std::format("Unknown data format `{}`", s));
+	}
+
+	std::filesystem::path DataReader::cachePath() const
+	{
+		return m_filename + ".cache";
+	}
+
+	bool DataReader::useCache() const
+	{
+		return m_useCache && m_dataFormat == Format::numberList && m_filename.compare("-") != 0;
+	}
+
+	DataReader::CacheHeader DataReader::makeCacheHeader(uint64_t numEntries, bool withHash) const
+	{
+		CacheHeader header{};
+		std::memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+		header.version = cacheVersion;
+		header.numInputs = m_numInputs;
+		header.numOutputs = m_numOutputs;
+		header.numEntries = numEntries;
+
+		std::error_code ec;
+		header.sourceSize = std::filesystem::file_size(m_filename, ec);
+		header.sourceTime = std::filesystem::last_write_time(m_filename, ec).time_since_epoch().count();
+		header.sourceHash = withHash ? hashFile(m_filename) : 0;
+		return header;
+	}
+
+	bool DataReader::ValidCacheHeader(CacheHeader const& header) const
+	{
+		CacheHeader const source = makeCacheHeader(header.numEntries, false);
+		if (std::memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 || header.version != cacheVersion
+			|| header.numInputs != m_numInputs || header.numOutputs != m_numOutputs
+			|| header.sourceSize != source.sourceSize)
+		{
+			return false;
+		}
+
+		// A file touched without being modified keeps its cache
+		return header.sourceTime == source.sourceTime || header.sourceHash == hashFile(m_filename);
+	}
+
+	bool DataReader::ReadCache(std::vector<TrainingEntry>& entries) const
+	{
+		std::error_code ec;
+		std::filesystem::path const path = cachePath();
+		std::size_t const fileSize = std::filesystem::file_size(path, ec);
+		if (ec || fileSize < sizeof(CacheHeader))
+		{
+			return false;
+		}
+
+		CacheHeader header{};
+		auto load = [&](const char* bytes)
+		{
+			std::memcpy(&header, bytes, sizeof(header));
+			if (!ValidCacheHeader(header)
+				|| fileSize != sizeof(header) + header.numEntries * entryBytes(m_numInputs, m_numOutputs))
+			{
+				return false;
+			}
+
+			// The header size keeps the doubles then the int32_t aligned
+			const double* inputs = reinterpret_cast<const double*>(bytes + sizeof(header));
+			const int32_t* outputs = reinterpret_cast<const int32_t*>(inputs + header.numEntries * m_numInputs);
+			entries.resize(header.numEntries);
+			for (TrainingEntry& entry : entries)
+			{
+				entry.m_inputs.assign(inputs, inputs + m_numInputs);
+				entry.m_expectedOutputs.assign(outputs, outputs + m_numOutputs);
+				inputs += m_numInputs;
+				outputs += m_numOutputs;
+			}
+			return true;
+		};
+
+#if defined(__unix__)
+		int const fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			return false;
+		}
+		void* const mapping = ::mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (mapping == MAP_FAILED)
+		{
+			return false;
+		}
+		::madvise(mapping, fileSize, MADV_SEQUENTIAL);
+		bool const loaded = load(static_cast<const char*>(mapping));
+		::munmap(mapping, fileSize);
+#else
+		std::vector<double> contents((fileSize + sizeof(double) - 1) / sizeof(double));
+		bool const loaded = std::ifstream(path, std::ios::in | std::ios::binary).read((char*)contents.data(), fileSize)
+			&& load(reinterpret_cast<const char*>(contents.data()));
+#endif
+		if (!loaded)
+		{
+			entries.clear();
+			return false;
+		}
+
+		// Source touched without being modified : the cache records its new
+		// time, so that the next loads do not hash the source again
+		if (int64_t const sourceTime = makeCacheHeader(header.numEntries, false).sourceTime; header.sourceTime != sourceTime)
+		{
+			header.sourceTime = sourceTime;
+			std::fstream(path, std::ios::in | std::ios::out | std::ios::binary).write((const char*)&header, sizeof(header));
+		}
+		return true;
+	}
+
+	void DataReader::WriteCache(std::vector<TrainingEntry> const& entries) const
+	{
+		std::filesystem::path const path = cachePath();
+		CacheHeader const header = makeCacheHeader(entries.size(), true);
+		try
+		{
+			writeFileAtomically(path, [&](std::ostream& file)
+			{
+				file.write((const char*)&header, sizeof(header));
+				for (TrainingEntry const& entry : entries)
+				{
+					file.write((const char*)entry.m_inputs.data(), m_numInputs * sizeof(double));
+				}
+				for (TrainingEntry const& entry : entries)
+				{
+					file.write((const char*)entry.m_expectedOutputs.data(), m_numOutputs * sizeof(int32_t));
+				}
+			});
+		}
+		catch (const std::exception& e)
+		{
+			// Without the cache, the next runs parse the text again
+			if (m_verbosity >= 1)
+			{
+				std::cout << "Could not write the data cache: " << e.what() << std::endl;
+			}
+			return;
+		}
+
+		if (m_verbosity >= 1)
+		{
+			std::cout << "Wrote the data cache `" << path.string() << "`" << std::endl;
+		}
+	}
+
 	void DataReader::CreateTrainingData(TrainingData& data, std::vector<TrainingEntry>& entries)
 	{
 		assert(!entries.empty());
 
-		std::random_device rd;
-		std::mt19937 g(rd());
+		std::mt19937 g(randomSeed(RandomStream::shuffle));
 		std::shuffle(entries.begin(), entries.end(), g);
 
 		// Training set
@@ -221,20 +471,22 @@ namespace bpn
 		int32_t entryIdx = 0;
 		for (; entryIdx < numTrainingEntries; entryIdx++)
 		{
-			data.m_trainingSet.push_back(entries[entryIdx]);
+			data.m_trainingSet.push_back(std::move(entries[entryIdx]));
 		}
 
 		// Generalization set
 		for (; entryIdx < numTrainingEntries + numGeneralizationEntries; entryIdx++)
 		{
-			data.m_generalizationSet.push_back(entries[entryIdx]);
+			data.m_generalizationSet.push_back(std::move(entries[entryIdx]));
 		}
 
 		// Validation set
 		for (; entryIdx < numEntries; entryIdx++)
 		{
-			data.m_validationSet.push_back(entries[entryIdx]);
+			data.m_validationSet.push_back(std::move(entries[entryIdx]));
 		}
+
+		data.updateMemory();
 	}
 }
 
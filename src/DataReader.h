@@ -8,7 +8,9 @@
 #pragma once
 
 #include "NeuralNetworkTrainer.h"
+#include <filesystem>
 #include <string>
+#include <string_view>
 
 //-------------------------------------------------------------------------
 
@@ -35,10 +37,38 @@ namespace bpn
 		inline int32_t getNumOutputs() const { return m_numOutputs; }
 
 		inline int32_t getNumTrainingSets() const { return 0; }
+
+		/**
+		 * Enables the binary cache of ``numberList`` files (on by default).
+		 * The first load writes the parsed entries to ``<file>.cache`` and the
+		 * next loads read them back, through mmap where available, as long as
+		 * the file keeps the same size, modification time (or content hash)
+		 * and the network the same numbers of inputs and outputs.
+		 */
+		inline void setUseCache(bool useCache) { m_useCache = useCache; }
+		std::filesystem::path cachePath() const;
+
+		static Format parseFormat(std::string_view s);
 		bool readTraningData(TrainingData& data);
 
 		bool readOneInputData(std::vector<double>& entries);
 
+		/**
+		 * Entries that ``readTraningData`` will load, and the bytes they will
+		 * hold. Both are 0 when it cannot be known in advance (e.g. reading
+		 * stdin).
+		 */
+		std::size_t plannedEntries() const;
+		std::size_t plannedFootprint() const;
+
+		/**
+		 * Bytes held by one training entry in memory.
+		 */
+		static std::size_t entryFootprint(int32_t numInputs, int32_t numOutputs)
+		{
+			return sizeof(TrainingEntry) + numInputs * sizeof(double) + numOutputs * sizeof(int32_t);
+		}
+
 		bool hasMoreData() const
 		{
 			return !m_dataStream->eof();
@@ -48,6 +78,35 @@ namespace bpn
 
 		static void CreateTrainingData(TrainingData& data, std::vector<TrainingEntry>& entries);
 
+		// Header of the binary cache file, followed by the inputs of every
+		// entry as doubles then their expected outputs as int32_t
+		struct CacheHeader
+		{
+			char     magic[8];
+			uint32_t version;
+			int32_t  numInputs;
+			int32_t  numOutputs;
+			uint32_t reserved;
+			uint64_t numEntries;
+			uint64_t sourceSize;
+			int64_t  sourceTime;        // last write time of the source file
+			uint64_t sourceHash;        // FNV-1a of the source file content
+		};
+
+		static std::size_t entryBytes(int32_t numInputs, int32_t numOutputs)
+		{
+			return numInputs * sizeof(double) + numOutputs * sizeof(int32_t);
+		}
+
+		bool useCache() const;
+		CacheHeader makeCacheHeader(uint64_t numEntries, bool withHash) const;
+
+		// Returns false, leaving ``entries`` empty, when there is no cache
+		// matching the source file
+		bool ReadCache(std::vector<TrainingEntry>& entries) const;
+		bool ValidCacheHeader(CacheHeader const& header) const;
+		void WriteCache(std::vector<TrainingEntry> const& entries) const;
+
 	private:
 
 		std::string      m_filename;
@@ -56,5 +115,6 @@ namespace bpn
 		int32_t          m_numOutputs;
 		Format  m_dataFormat;
 		int32_t          m_verbosity;
+		bool             m_useCache = true;
 	};
 }
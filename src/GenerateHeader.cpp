@@ -0,0 +1,75 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+// Writes the standalone C++ header of a network (see CodeGenerator.h).
+//
+//     generateBPN <model file> <header> <namespace>
+//     generateBPN --random <layers> <activation> <model file> <header> <namespace>
+//
+// The first form compiles a network exported by trainBPN. The second one
+// creates an untrained network with a softmax output, writes it to the
+// model file and compiles it, for the benchmark target.
+
+#include "CodeGenerator.h"
+#include "vectorstream.h"
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+
+using bpn::operator>>;
+
+int main(int argc, char** argv)
+{
+	std::vector<std::string> const args(argv + 1, argv + argc);
+	bool const random = !args.empty() && args[0] == "--random";
+	if (args.size() != (random ? 6u : 3u))
+	{
+		std::cerr << "Usage: generateBPN <model file> <header> <namespace>\n"
+			<< "       generateBPN --random <layers> <activation> <model file> <header> <namespace>" << std::endl;
+		return 1;
+	}
+
+	try
+	{
+		std::optional<bpn::Network> network;
+		std::string const& modelFile = args[random ? 3 : 0];
+		if (random)
+		{
+			std::vector<int> layerSizes;
+			std::stringstream ss(args[1]);
+			ss >> layerSizes;
+			network.emplace(layerSizes,
+				bpn::ActivationFunction::deserializeList(args[2], layerSizes.size() - 1),
+				"");
+			network->setSoftmaxOutput(true);
+			std::ofstream(modelFile) << network->serialize() << std::endl;
+		}
+		else
+		{
+			std::ifstream is(modelFile);
+			if (!is.good())
+			{
+				std::cerr << "Error: unable to read `" << modelFile << "`" << std::endl;
+				return 1;
+			}
+			network.emplace(is);
+		}
+
+		std::ofstream header(args[random ? 4 : 1]);
+		header << bpn::generateHeader(*network, args[random ? 5 : 2]);
+		if (!header.good())
+		{
+			std::cerr << "Error: unable to write `" << args[random ? 4 : 1] << "`" << std::endl;
+			return 1;
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
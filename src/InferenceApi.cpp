@@ -0,0 +1,161 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+
+#include "InferenceApi.h"
+#include "NeuralNetwork.h"
+#include <format>
+#include <fstream>
+#include <string>
+#include <string_view>
+
+struct bpn_network
+{
+	explicit bpn_network(std::istream& is)
+		: network(is)
+	{ }
+
+	explicit bpn_network(std::string_view text)
+		: network(text)
+	{ }
+
+	bpn::Network network;
+};
+
+namespace
+{
+	thread_local std::string lastError;
+
+	// Runs ``f``, turning its exceptions into ``error`` and the message of
+	// bpn_last_error
+	template<typename F, typename R>
+	R guard(F f, R error)
+	{
+		try
+		{
+			return f();
+		}
+		catch (const std::exception& e)
+		{
+			lastError = e.what();
+		}
+		catch (...)
+		{
+			lastError = "Unknown error";
+		}
+		return error;
+	}
+
+	template<typename Source>
+	bpn_network* load(Source&& source)
+	{
+		return guard([&]() { return new bpn_network(source); }, static_cast<bpn_network*>(nullptr));
+	}
+
+	bool checkSizes(const bpn_network* network, size_t numInputs, size_t numOutputs)
+	{
+		if (network == nullptr)
+		{
+			lastError = "Null network";
+			return false;
+		}
+		if (numInputs != bpn_num_inputs(network) || numOutputs < bpn_num_outputs(network))
+		{
+			lastError = std::format("Expected {} inputs and room for {} outputs", bpn_num_inputs(network),
+				bpn_num_outputs(network));
+			return false;
+		}
+		return true;
+	}
+}
+
+extern "C"
+{
+	bpn_network* bpn_load(const char* path)
+	{
+		if (path == nullptr)
+		{
+			lastError = "Null path";
+			return nullptr;
+		}
+		std::ifstream is(path);
+		if (!is.good())
+		{
+			lastError = std::format("Unable to read `{}`", path);
+			return nullptr;
+		}
+		return load(is);
+	}
+
+	bpn_network* bpn_load_from_memory(const char* data, size_t size)
+	{
+		if (data == nullptr && size > 0)
+		{
+			lastError = "Null data";
+			return nullptr;
+		}
+		// Parsed in place, without a copy
+		return load(std::string_view(data, size));
+	}
+
+	void bpn_free(bpn_network* network)
+	{
+		delete network;
+	}
+
+	size_t bpn_num_inputs(const bpn_network* network)
+	{
+		return network != nullptr ? network->network.getNumInputs() : 0;
+	}
+
+	size_t bpn_num_outputs(const bpn_network* network)
+	{
+		return network != nullptr ? network->network.getNumOutputs() : 0;
+	}
+
+	int bpn_set_threads(bpn_network* network, size_t num_threads)
+	{
+		if (network == nullptr || num_threads == 0)
+		{
+			lastError = "Null network or no thread";
+			return -1;
+		}
+		return guard([&]()
+		{
+			network->network.setIntraLayerThreads(static_cast<int32_t>(num_threads));
+			return 0;
+		}, -1);
+	}
+
+	int bpn_evaluate(bpn_network* network, const double* input, size_t numInputs, double* output, size_t numOutputs)
+	{
+		if (!checkSizes(network, numInputs, numOutputs))
+		{
+			return -1;
+		}
+		return guard([&]()
+		{
+			network->network.Evaluate({ input, numInputs }, { output, numOutputs });
+			return 0;
+		}, -1);
+	}
+
+	int bpn_top_k(bpn_network* network, const double* input, size_t numInputs,
+		int32_t* classes, double* probabilities, size_t k)
+	{
+		if (!checkSizes(network, numInputs, network != nullptr ? bpn_num_outputs(network) : 0))
+		{
+			return -1;
+		}
+		return guard([&]()
+		{
+			return static_cast<int>(network->network.topK({ input, numInputs }, { classes, k }, { probabilities, k }));
+		}, -1);
+	}
+
+	const char* bpn_last_error(void)
+	{
+		return lastError.c_str();
+	}
+}
@@ -0,0 +1,66 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+// C interface of the bpn library, to score with a trained network from
+// other languages or services. Memory is only allocated when a network is
+// loaded, the evaluation functions write in buffers owned by the caller.
+// A network must not be evaluated by several threads at once, load one
+// network per thread instead.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct bpn_network bpn_network;
+
+/**
+ * Loads a network exported by trainBPN from a file, or from ``size``
+ * bytes of memory. Returns NULL on error, see ``bpn_last_error``.
+ */
+bpn_network* bpn_load(const char* path);
+bpn_network* bpn_load_from_memory(const char* data, size_t size);
+
+void bpn_free(bpn_network* network);
+
+/** Numbers of inputs and outputs of ``network``, 0 for NULL. */
+size_t bpn_num_inputs(const bpn_network* network);
+size_t bpn_num_outputs(const bpn_network* network);
+
+/**
+ * Splits the wide layers of ``network`` between ``num_threads`` threads,
+ * the calling one included, to reduce the latency of single evaluations.
+ * The threads spin between evaluations. 1 (the default) evaluates on the
+ * calling thread only. Returns 0, or -1 on error.
+ */
+int bpn_set_threads(bpn_network* network, size_t num_threads);
+
+/**
+ * Writes in ``output`` the output values of the network for ``input``.
+ * ``numInputs`` and ``numOutputs`` are the sizes of the buffers. Returns 0,
+ * or -1 on error.
+ */
+int bpn_evaluate(bpn_network* network, const double* input, size_t numInputs, double* output, size_t numOutputs);
+
+/**
+ * Writes in ``classes`` the ``k`` output neurons with the largest values
+ * for ``input``, best first, and their values (probabilities with a
+ * softmax output) in ``probabilities``. Returns the number of classes
+ * written, at most ``k``, or -1 on error.
+ */
+int bpn_top_k(bpn_network* network, const double* input, size_t numInputs,
+	int32_t* classes, double* probabilities, size_t k);
+
+/**
+ * Message of the last error of the calling thread.
+ */
+const char* bpn_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
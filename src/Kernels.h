@@ -0,0 +1,157 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+// Dense kernels shared by the forward and backward passes. Matrices are
+// row major, A(r, c) is A[r * cols + c], with one row per neuron of the
+// previous layer as in Network::m_weightsByLayer.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace bpn::kernels
+{
+	// Block sizes of ``multiplyTransposedAddBatch``, see AutoTuner
+	struct BatchTiling
+	{
+		std::size_t samples = 8;     // inputs sharing each row of weights
+		std::size_t columns = 512;   // columns of the output kept in cache
+	};
+
+	/**
+	 * sum_i a[i] * b[i]
+	 *
+	 * Four independent partial sums let the compiler vectorize the
+	 * reduction. They are always added in the same order, so the result
+	 * does not depend on the hardware.
+	 */
+	inline double dot(const double* __restrict a, const double* __restrict b, std::size_t n) noexcept
+	{
+		double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+		std::size_t i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			s0 += a[i] * b[i];
+			s1 += a[i + 1] * b[i + 1];
+			s2 += a[i + 2] * b[i + 2];
+			s3 += a[i + 3] * b[i + 3];
+		}
+		for (; i < n; ++i)
+		{
+			s0 += a[i] * b[i];
+		}
+		return (s0 + s1) + (s2 + s3);
+	}
+
+	// y[i] += alpha * x[i]
+	inline void axpy(double alpha, const double* __restrict x, double* __restrict y, std::size_t n) noexcept
+	{
+		for (std::size_t i = 0; i < n; ++i)
+		{
+			y[i] += alpha * x[i];
+		}
+	}
+
+	// ``x`` rounded to the nearest multiple of ``quantum``, a power of two
+	inline double quantize(double x, double quantum) noexcept
+	{
+		return std::nearbyint(x / quantum) * quantum;
+	}
+
+	/**
+	 * y[i] += alpha * x[i] rounded to a multiple of ``quantum``, a power of
+	 * two. The y[i] stay multiples of ``quantum`` and their additions are
+	 * exact below 2^53 quantums, so the sums do not depend on their order.
+	 * Adding and subtracting 1.5 * 2^52 rounds to the nearest integer below
+	 * 2^51 quantums, without a call to nearbyint, so the loop vectorizes.
+	 */
+	inline void axpyQuantized(double alpha, const double* __restrict x, double* __restrict y, std::size_t n,
+		double quantum) noexcept
+	{
+		double const scale = 1.0 / quantum;
+		double const round = 0x1.8p52;
+		for (std::size_t i = 0; i < n; ++i)
+		{
+			y[i] += ((alpha * x[i] * scale + round) - round) * quantum;
+		}
+	}
+
+	/**
+	 * y = A * x, A being rows x cols. This is the backward pass : rows are
+	 * the neurons of a layer, x the error gradients of the next layer.
+	 */
+	inline void multiply(const double* A, const double* __restrict x, double* __restrict y,
+		std::size_t rows, std::size_t cols) noexcept
+	{
+		for (std::size_t r = 0; r < rows; ++r)
+		{
+			y[r] = dot(A + r * cols, x, cols);
+		}
+	}
+
+	/**
+	 * y += A^T * x, A being rows x cols, one contiguous row of A per
+	 * element of x, row r starting at A + r * stride. This is the forward
+	 * pass : rows of zero inputs are skipped. A stride larger than cols
+	 * selects a block of columns, every y[c] being summed in the same
+	 * order whatever the block.
+	 */
+	inline void multiplyTransposedAdd(const double* A, const double* __restrict x, double* __restrict y,
+		std::size_t rows, std::size_t cols, std::size_t stride) noexcept
+	{
+		for (std::size_t r = 0; r < rows; ++r)
+		{
+			if (x[r] != 0.0)
+			{
+				axpy(x[r], A + r * stride, y, cols);
+			}
+		}
+	}
+
+	// Same as multiplyTransposedAdd, restricted to the rows listed in ``rowIndices``
+	inline void multiplyTransposedAddRows(const double* A, std::span<const int32_t> rowIndices,
+		const double* __restrict x, double* __restrict y, std::size_t cols, std::size_t stride) noexcept
+	{
+		for (int32_t r : rowIndices)
+		{
+			axpy(x[r], A + r * stride, y, cols);
+		}
+	}
+
+	/**
+	 * Y += X * A for a batch : row b of Y (batch x cols) gets the
+	 * multiplyTransposedAdd of row b of X (batch x rows). Blocks of
+	 * ``tiling.samples`` inputs and ``tiling.columns`` columns read each row
+	 * of A once per block of inputs while their outputs stay in cache. Every
+	 * Y(b, c) is summed in the same order whatever the tiling.
+	 */
+	inline void multiplyTransposedAddBatch(const double* A, const double* X, double* Y,
+		std::size_t batch, std::size_t rows, std::size_t cols, BatchTiling tiling) noexcept
+	{
+		for (std::size_t firstSample = 0; firstSample < batch; firstSample += tiling.samples)
+		{
+			std::size_t const endSample = std::min(batch, firstSample + tiling.samples);
+			for (std::size_t firstCol = 0; firstCol < cols; firstCol += tiling.columns)
+			{
+				std::size_t const width = std::min(cols - firstCol, tiling.columns);
+				for (std::size_t r = 0; r < rows; ++r)
+				{
+					const double* a = A + r * cols + firstCol;
+					for (std::size_t b = firstSample; b < endSample; ++b)
+					{
+						double const x = X[b * rows + r];
+						if (x != 0.0)
+						{
+							axpy(x, a, Y + b * cols + firstCol, width);
+						}
+					}
+				}
+			}
+		}
+	}
+}
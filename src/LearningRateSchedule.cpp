@@ -0,0 +1,42 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+
+#include "LearningRateSchedule.h"
+#include "Parameters.h"
+#include <stdexcept>
+#include <vector>
+
+namespace bpn
+{
+	std::unique_ptr<LearningRateSchedule> LearningRateSchedule::deserialize(std::string_view s,
+		double baseRate, uint64_t maxEpochs, uint64_t warmupEpochs)
+	{
+		std::string_view const name = s.substr(0, s.find('('));
+
+		std::vector<double> const parameters = parseParameters(s, "learning rate schedule");
+
+		if (name == "constant")
+		{
+			return std::make_unique<ConstantSchedule>(baseRate, warmupEpochs);
+		}
+		else if (name == "step")
+		{
+			uint64_t const stepEpochs = parameters.size() > 0 ? static_cast<uint64_t>(parameters[0]) : 10;
+			double const factor = parameters.size() > 1 ? parameters[1] : 0.5;
+			if (stepEpochs == 0)
+			{
+				throw std::runtime_error(std::format("Invalid learning rate schedule `{}`", s));
+			}
+			return std::make_unique<StepSchedule>(baseRate, warmupEpochs, stepEpochs, factor);
+		}
+		else if (name == "cosine")
+		{
+			uint64_t const decayEpochs = maxEpochs > warmupEpochs ? maxEpochs - warmupEpochs : 1;
+			return std::make_unique<CosineSchedule>(baseRate, warmupEpochs, decayEpochs);
+		}
+
+		throw std::runtime_error(std::format("Unknown learning rate schedule `{}`", s));
+	}
+}
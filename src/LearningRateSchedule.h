@@ -0,0 +1,136 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+// Learning rate as a function of the epoch.
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <format>
+#include <memory>
+#include <numbers>
+#include <string>
+#include <string_view>
+
+namespace bpn
+{
+	class LearningRateSchedule
+	{
+	public:
+		LearningRateSchedule(double baseRate, uint64_t warmupEpochs)
+			: baseRate{ baseRate }, warmupEpochs{ warmupEpochs }
+		{ }
+
+		virtual ~LearningRateSchedule() = default;
+
+		/**
+		 * Learning rate to use during ``epoch`` (starting at 0). The rate
+		 * grows linearly up to ``baseRate`` during the warmup epochs, then
+		 * follows the schedule.
+		 */
+		double learningRate(uint64_t epoch) const
+		{
+			if (epoch < warmupEpochs)
+			{
+				return baseRate * (epoch + 1) / (warmupEpochs + 1);
+			}
+			return rate(epoch - warmupEpochs);
+		}
+
+		/**
+		 * Representation of the schedule as text.
+		 */
+		virtual std::string serialize() const = 0;
+
+		/**
+		 * Builds a schedule from its text representation, for instance
+		 * ``constant``, ``step(10,0.5)`` or ``cosine``. ``maxEpochs`` is the
+		 * length of the training used by the cosine schedule.
+		 */
+		static std::unique_ptr<LearningRateSchedule> deserialize(std::string_view s,
+			double baseRate, uint64_t maxEpochs, uint64_t warmupEpochs);
+
+		const double   baseRate;
+		const uint64_t warmupEpochs;
+
+	protected:
+		/**
+		 * Learning rate ``epoch`` epochs after the end of the warmup.
+		 */
+		virtual double rate(uint64_t epoch) const = 0;
+	};
+
+	class ConstantSchedule : public LearningRateSchedule
+	{
+	public:
+		using LearningRateSchedule::LearningRateSchedule;
+
+		std::string serialize() const override
+		{
+			return "constant";
+		}
+
+	protected:
+		double rate(uint64_t) const override
+		{
+			return baseRate;
+		}
+	};
+
+	class StepSchedule : public LearningRateSchedule
+	{
+		/**
+		 * rate = baseRate * factor^(floor(epoch / stepEpochs))
+		 */
+	public:
+		StepSchedule(double baseRate, uint64_t warmupEpochs, uint64_t stepEpochs, double factor)
+			: LearningRateSchedule(baseRate, warmupEpochs), stepEpochs{ stepEpochs }, factor{ factor }
+		{ }
+
+		std::string serialize() const override
+		{
+			return std::format("step({},{})", stepEpochs, factor);
+		}
+
+		const uint64_t stepEpochs;
+		const double   factor;
+
+	protected:
+		double rate(uint64_t epoch) const override
+		{
+			return baseRate * std::pow(factor, static_cast<double>(epoch / stepEpochs));
+		}
+	};
+
+	class CosineSchedule : public LearningRateSchedule
+	{
+		/**
+		 * Cosine annealing from baseRate down to 0 over ``decayEpochs``.
+		 *
+		 * rate = baseRate * (1 + cos(pi * epoch / decayEpochs)) / 2
+		 */
+	public:
+		CosineSchedule(double baseRate, uint64_t warmupEpochs, uint64_t decayEpochs)
+			: LearningRateSchedule(baseRate, warmupEpochs), decayEpochs{ decayEpochs }
+		{ }
+
+		std::string serialize() const override
+		{
+			return "cosine";
+		}
+
+		const uint64_t decayEpochs;
+
+	protected:
+		double rate(uint64_t epoch) const override
+		{
+			if (epoch >= decayEpochs)
+			{
+				return 0.0;
+			}
+			return baseRate * (1.0 + std::cos(std::numbers::pi * epoch / decayEpochs)) / 2.0;
+		}
+	};
+}
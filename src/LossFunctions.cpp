@@ -0,0 +1,87 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+
+#include "LossFunctions.h"
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+
+namespace bpn
+{
+	std::unique_ptr<LossFunction> LossFunction::deserialize(std::string_view s)
+	{
+		if (s == "MSE")
+		{
+			return std::make_unique<MeanSquaredError>();
+		}
+		else if (s == "CrossEntropy")
+		{
+			return std::make_unique<CrossEntropy>();
+		}
+
+		throw std::runtime_error(std::format("Unknown loss function `{}`", s));
+	}
+
+	void MeanSquaredError::outputErrorGradients(const Network& network,
+		std::vector<int32_t> const& expectedOutputs,
+		double* errorGradients) const
+	{
+		int32_t const outputLayer = network.getNumLayers() - 1;
+		const ActivationFunction& sigma = network.activationFunction(outputLayer);
+		for (int32_t outputIdx = 0; outputIdx < network.getNumOutputs(); ++outputIdx)
+		{
+			double const value = network.getValue(outputLayer, outputIdx);
+			double const derivative = sigma.evalDerivative(network.getActivation(outputLayer, outputIdx), value);
+			errorGradients[outputIdx] = derivative * (expectedOutputs[outputIdx] - value);
+		}
+	}
+
+	void MeanSquaredError::outputErrorGradients(const Network& network,
+		std::span<const double> targets,
+		double* errorGradients) const
+	{
+		int32_t const outputLayer = network.getNumLayers() - 1;
+		const ActivationFunction& sigma = network.activationFunction(outputLayer);
+		for (int32_t outputIdx = 0; outputIdx < network.getNumOutputs(); ++outputIdx)
+		{
+			double const value = network.getValue(outputLayer, outputIdx);
+			double const derivative = sigma.evalDerivative(network.getActivation(outputLayer, outputIdx), value);
+			errorGradients[outputIdx] = derivative * (targets[outputIdx] - value);
+		}
+	}
+
+	bool MeanSquaredError::isCorrect(const Network& network, std::vector<int32_t> const& expectedOutputs) const
+	{
+		return network.getOutput() == expectedOutputs;
+	}
+
+	void CrossEntropy::outputErrorGradients(const Network& network,
+		std::vector<int32_t> const& expectedOutputs,
+		double* errorGradients) const
+	{
+		int32_t const outputLayer = network.getNumLayers() - 1;
+		for (int32_t outputIdx = 0; outputIdx < network.getNumOutputs(); ++outputIdx)
+		{
+			errorGradients[outputIdx] = expectedOutputs[outputIdx] - network.getValue(outputLayer, outputIdx);
+		}
+	}
+
+	void CrossEntropy::outputErrorGradients(const Network& network,
+		std::span<const double> targets,
+		double* errorGradients) const
+	{
+		int32_t const outputLayer = network.getNumLayers() - 1;
+		for (int32_t outputIdx = 0; outputIdx < network.getNumOutputs(); ++outputIdx)
+		{
+			errorGradients[outputIdx] = targets[outputIdx] - network.getValue(outputLayer, outputIdx);
+		}
+	}
+
+	bool CrossEntropy::isCorrect(const Network& network, std::vector<int32_t> const& expectedOutputs) const
+	{
+		auto const expectedClass = std::ranges::max_element(expectedOutputs) - expectedOutputs.begin();
+		return network.getPredictedClass() == expectedClass;
+	}
+}
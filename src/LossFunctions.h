@@ -0,0 +1,121 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include "NeuralNetwork.h"
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace bpn
+{
+	class LossFunction
+	{
+	public:
+		virtual ~LossFunction() = default;
+
+		/**
+		 * Error gradient of every output neuron of ``network`` after an
+		 * evaluation, i.e. minus the derivative of the loss with respect to
+		 * the activation (weighted sum) of the neuron.
+		 */
+		virtual void outputErrorGradients(const Network& network,
+			std::vector<int32_t> const& expectedOutputs,
+			double* errorGradients) const = 0;
+
+		/**
+		 * Same with soft ``targets`` (one value per output neuron), e.g. a
+		 * blend of the outputs of a teacher network and of the expected
+		 * outputs.
+		 */
+		virtual void outputErrorGradients(const Network& network,
+			std::span<const double> targets,
+			double* errorGradients) const = 0;
+
+		/**
+		 * Whether the last evaluation of ``network`` is a correct answer.
+		 */
+		virtual bool isCorrect(const Network& network, std::vector<int32_t> const& expectedOutputs) const = 0;
+
+		/**
+		 * Whether the output layer must be normalized with a softmax.
+		 */
+		virtual bool usesSoftmaxOutput() const = 0;
+
+		/**
+		 * Representation of the function as text.
+		 */
+		virtual std::string serialize() const = 0;
+
+		static std::unique_ptr<LossFunction> deserialize(std::string_view s);
+	};
+
+	class MeanSquaredError : public LossFunction
+	{
+		/**
+		 * L = 1/2 * sum (y_i - t_i)^2   where y_i = f(x_i)
+		 *
+		 * -dL/dx_i = f'(x_i) * (t_i - y_i)
+		 *
+		 * An answer is correct when every clamped output matches.
+		 */
+	public:
+		void outputErrorGradients(const Network& network,
+			std::vector<int32_t> const& expectedOutputs,
+			double* errorGradients) const override;
+		void outputErrorGradients(const Network& network,
+			std::span<const double> targets,
+			double* errorGradients) const override;
+
+		bool isCorrect(const Network& network, std::vector<int32_t> const& expectedOutputs) const override;
+
+		bool usesSoftmaxOutput() const override
+		{
+			return false;
+		}
+
+		std::string serialize() const override
+		{
+			return "MSE";
+		}
+	};
+
+	class CrossEntropy : public LossFunction
+	{
+		/**
+		 * Softmax output with cross-entropy loss.
+		 *
+		 * y_i = exp(x_i) / sum exp(x_j)
+		 * L = - sum t_i * log(y_i)
+		 *
+		 * Both are differentiated together, which cancels the softmax
+		 * Jacobian : -dL/dx_i = t_i - y_i
+		 *
+		 * An answer is correct when the largest output is the expected class.
+		 */
+	public:
+		void outputErrorGradients(const Network& network,
+			std::vector<int32_t> const& expectedOutputs,
+			double* errorGradients) const override;
+		void outputErrorGradients(const Network& network,
+			std::span<const double> targets,
+			double* errorGradients) const override;
+
+		bool isCorrect(const Network& network, std::vector<int32_t> const& expectedOutputs) const override;
+
+		bool usesSoftmaxOutput() const override
+		{
+			return true;
+		}
+
+		std::string serialize() const override
+		{
+			return "CrossEntropy";
+		}
+	};
+}
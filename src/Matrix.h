@@ -8,6 +8,8 @@
 
 #pragma once
 
+#include "Arena.h"
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <vector>
@@ -18,7 +20,7 @@ namespace bpn
 	{
 	public:
 		constexpr Matrix(int nRows, int nCols, double value = 0.0) noexcept
-			: nRows{ nRows }, nCols{ nCols }, data(nRows * nCols, value)
+			: nRows{ nRows }, nCols{ nCols }, elements(nRows * nCols, value)
 		{
 			assert(nRows > 0 && nCols > 0 && "Matrix constructor has 0 size");
 		}
@@ -27,14 +29,50 @@ namespace bpn
 		[[nodiscard]] constexpr double& operator()(int r, int c)
 		{
 			assert(r >= 0 && r < nRows && c >= 0 && c < nCols && "Matrix subscript out of bounds");
-			return data[r * nCols + c];
+			return elements[r * nCols + c];
 		}
 
 		// TODO Multidimensional subscript operator when MSVC supports it
 		[[nodiscard]] constexpr double operator()(int r, int c) const
 		{
 			assert(r >= 0 && r < nRows && c >= 0 && c < nCols && "Matrix subscript out of bounds");
-			return data[r * nCols + c];
+			return elements[r * nCols + c];
+		}
+
+		[[nodiscard]] constexpr int rows() const noexcept
+		{
+			return nRows;
+		}
+
+		[[nodiscard]] constexpr int cols() const noexcept
+		{
+			return nCols;
+		}
+
+		// Row major storage, element (r, c) is at ``data()[r * cols() + c]``
+		[[nodiscard]] constexpr double* data() noexcept
+		{
+			return elements.data();
+		}
+
+		[[nodiscard]] constexpr const double* data() const noexcept
+		{
+			return elements.data();
+		}
+
+		[[nodiscard]] constexpr std::size_t size() const noexcept
+		{
+			return elements.size();
+		}
+
+		constexpr void fill(double value) noexcept
+		{
+			std::fill(elements.begin(), elements.end(), value);
+		}
+
+		[[nodiscard]] constexpr std::size_t byteSize() const noexcept
+		{
+			return elements.capacity() * sizeof(double);
 		}
 
 		friend std::ostream& operator<<(std::ostream& os, const Matrix& m);
@@ -42,6 +80,6 @@ namespace bpn
 	private:
 		const int nRows;
 		const int nCols;
-		std::vector<double> data;
+		std::vector<double, AlignedAllocator<double>> elements; // cache line aligned
 	};
 }
\ No newline at end of file
@@ -0,0 +1,144 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+
+#include "MemoryTracker.h"
+#include <charconv>
+#include <format>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace bpn
+{
+	namespace
+	{
+		void raisePeak(std::atomic<std::size_t>& peak, std::size_t value) noexcept
+		{
+			std::size_t previous = peak.load(std::memory_order_relaxed);
+			while (previous < value && !peak.compare_exchange_weak(previous, value, std::memory_order_relaxed))
+			{
+			}
+		}
+	}
+
+	void MemoryTracker::allocate(Category category, std::size_t bytes) noexcept
+	{
+		std::size_t const idx = static_cast<std::size_t>(category);
+		raisePeak(s_peak[idx], s_current[idx].fetch_add(bytes, std::memory_order_relaxed) + bytes);
+		raisePeak(s_totalPeak, s_total.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+	}
+
+	void MemoryTracker::release(Category category, std::size_t bytes) noexcept
+	{
+		s_current[static_cast<std::size_t>(category)].fetch_sub(bytes, std::memory_order_relaxed);
+		s_total.fetch_sub(bytes, std::memory_order_relaxed);
+	}
+
+	std::size_t MemoryTracker::current() noexcept
+	{
+		return s_total.load(std::memory_order_relaxed);
+	}
+
+	std::size_t MemoryTracker::current(Category category) noexcept
+	{
+		return s_current[static_cast<std::size_t>(category)].load(std::memory_order_relaxed);
+	}
+
+	std::size_t MemoryTracker::peak() noexcept
+	{
+		return s_totalPeak.load(std::memory_order_relaxed);
+	}
+
+	std::size_t MemoryTracker::peak(Category category) noexcept
+	{
+		return s_peak[static_cast<std::size_t>(category)].load(std::memory_order_relaxed);
+	}
+
+	std::string_view MemoryTracker::categoryName(Category category) noexcept
+	{
+		switch (category)
+		{
+		case Category::dataset: return "dataset";
+		case Category::weights: return "weights";
+		case Category::neurons: return "neurons";
+		case Category::trainer: return "trainer";
+		case Category::scratch: return "scratch";
+		default: return "unknown";
+		}
+	}
+
+	std::string MemoryTracker::formatBytes(std::size_t bytes)
+	{
+		constexpr const char* units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+		double value = static_cast<double>(bytes);
+		std::size_t unit = 0;
+		while (value >= 1024.0 && unit + 1 < std::size(units))
+		{
+			value /= 1024.0;
+			++unit;
+		}
+		return unit == 0 ? std::format("{} B", bytes) : std::format("{:.1f} {}", value, units[unit]);
+	}
+
+	std::size_t MemoryTracker::parseBytes(std::string_view s)
+	{
+		if (s.empty())
+		{
+			return 0;
+		}
+
+		double value = 0;
+		auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+		if (ec != std::errc() || !(value >= 0.0))
+		{
+			throw std::runtime_error(std::format("Invalid memory amount `{}`", s));
+		}
+
+		// Optional K, M or G, then an optional B (or iB after the prefix)
+		std::string_view suffix(end, s.data() + s.size());
+		double multiplier = 1;
+		if (suffix.starts_with('K') || suffix.starts_with('k'))
+		{
+			multiplier = 1024.0;
+		}
+		else if (suffix.starts_with('M') || suffix.starts_with('m'))
+		{
+			multiplier = 1024.0 * 1024.0;
+		}
+		else if (suffix.starts_with('G') || suffix.starts_with('g'))
+		{
+			multiplier = 1024.0 * 1024.0 * 1024.0;
+		}
+		if (multiplier > 1)
+		{
+			suffix.remove_prefix(1);
+		}
+		if (!suffix.empty() && suffix != "B" && (multiplier == 1 || suffix != "iB"))
+		{
+			throw std::runtime_error(std::format("Invalid memory unit in `{}`", s));
+		}
+
+		double const bytes = value * multiplier;
+		if (bytes >= static_cast<double>(std::numeric_limits<std::size_t>::max()))
+		{
+			throw std::runtime_error(std::format("Invalid memory amount `{}`", s));
+		}
+		return static_cast<std::size_t>(bytes);
+	}
+
+	std::string MemoryTracker::summary()
+	{
+		std::ostringstream ss;
+		ss << " Memory usage (current / peak):\n";
+		for (std::size_t i = 0; i < numCategories; ++i)
+		{
+			Category const category = static_cast<Category>(i);
+			ss << std::format("   {:<8} : {} / {}\n", categoryName(category),
+				formatBytes(current(category)), formatBytes(peak(category)));
+		}
+		ss << std::format("   {:<8} : {} / {}\n", "total", formatBytes(current()), formatBytes(peak()));
+		return ss.str();
+	}
+}
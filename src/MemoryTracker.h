@@ -0,0 +1,142 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+// Central accounting of the memory held by the dataset, the network and
+// the trainer so that the peak footprint can be reported and budgeted.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace bpn
+{
+	class MemoryTracker
+	{
+	public:
+		enum class Category
+		{
+			dataset,     // TrainingData entries
+			weights,     // Network::m_weightsByLayer
+			neurons,     // Network neuron arena and clamped outputs
+			trainer,     // NetworkTrainer deltas and error gradients
+			scratch,     // Temporary buffers
+			count
+		};
+
+		/**
+		 * RAII handle for a block of tracked memory. The owner calls
+		 * ``update`` whenever the size of what it tracks changes, the bytes
+		 * are released when the handle is destroyed. Copies register the
+		 * same amount of bytes again since the tracked object was copied.
+		 */
+		class Registration
+		{
+		public:
+			explicit Registration(Category category, std::size_t bytes = 0) noexcept
+				: m_category{ category }, m_bytes{ 0 }
+			{
+				update(bytes);
+			}
+
+			Registration(const Registration& other) noexcept
+				: Registration(other.m_category, other.m_bytes)
+			{ }
+
+			Registration(Registration&& other) noexcept
+				: m_category{ other.m_category }, m_bytes{ other.m_bytes }
+			{
+				other.m_bytes = 0;
+			}
+
+			Registration& operator=(const Registration& other) noexcept
+			{
+				if (this != &other)
+				{
+					update(0);
+					m_category = other.m_category;
+					update(other.m_bytes);
+				}
+				return *this;
+			}
+
+			Registration& operator=(Registration&& other) noexcept
+			{
+				if (this != &other)
+				{
+					update(0);
+					m_category = other.m_category;
+					m_bytes = other.m_bytes;
+					other.m_bytes = 0;
+				}
+				return *this;
+			}
+
+			~Registration()
+			{
+				update(0);
+			}
+
+			void update(std::size_t bytes) noexcept
+			{
+				if (bytes > m_bytes)
+				{
+					MemoryTracker::allocate(m_category, bytes - m_bytes);
+				}
+				else if (bytes < m_bytes)
+				{
+					MemoryTracker::release(m_category, m_bytes - bytes);
+				}
+				m_bytes = bytes;
+			}
+
+			[[nodiscard]] std::size_t bytes() const noexcept
+			{
+				return m_bytes;
+			}
+
+		private:
+			Category    m_category;
+			std::size_t m_bytes;
+		};
+
+		static void allocate(Category category, std::size_t bytes) noexcept;
+		static void release(Category category, std::size_t bytes) noexcept;
+
+		[[nodiscard]] static std::size_t current() noexcept;
+		[[nodiscard]] static std::size_t current(Category category) noexcept;
+		[[nodiscard]] static std::size_t peak() noexcept;
+		[[nodiscard]] static std::size_t peak(Category category) noexcept;
+
+		static std::string_view categoryName(Category category) noexcept;
+
+		/**
+		 * Human readable amount of bytes (e.g. ``12.5 MiB``).
+		 */
+		static std::string formatBytes(std::size_t bytes);
+
+		/**
+		 * Parses a byte amount with an optional K, M or G suffix (powers of
+		 * 1024), e.g. ``512M``, ``2GiB``. Returns 0, meaning ``no budget``, on
+		 * an empty string, throws on a negative amount or an unknown unit.
+		 */
+		static std::size_t parseBytes(std::string_view s);
+
+		/**
+		 * Multi-line report of current and peak usage per category.
+		 */
+		static std::string summary();
+
+	private:
+		static constexpr std::size_t numCategories = static_cast<std::size_t>(Category::count);
+
+		inline static std::array<std::atomic<std::size_t>, numCategories> s_current{};
+		inline static std::array<std::atomic<std::size_t>, numCategories> s_peak{};
+		inline static std::atomic<std::size_t> s_total{};
+		inline static std::atomic<std::size_t> s_totalPeak{};
+	};
+}
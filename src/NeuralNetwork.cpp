@@ -19,17 +19,115 @@
 #include <string_view>
 #include <math.h>
 #include <format>
+#include <algorithm>
+#include <thread>
+#include <charconv>
+#include <iterator>
+#include <stdexcept>
 
 #include "NeuralNetwork.h"
+#include "Kernels.h"
+#include "Random.h"
 
 namespace bpn
 {
+	namespace
+	{
+		// White space separated tokens of a serialized network
+		class TokenReader
+		{
+		public:
+			explicit TokenReader(std::string_view text) noexcept
+				: m_text{ text }
+			{ }
+
+			// Next token, empty at the end of the text
+			std::string_view next() noexcept
+			{
+				skipSpaces();
+				std::size_t const begin = m_position;
+				while (m_position < m_text.size() && !isSpace(m_text[m_position]))
+				{
+					++m_position;
+				}
+				return m_text.substr(begin, m_position - begin);
+			}
+
+			void expect(std::string_view keyword)
+			{
+				if (std::string_view const token = next(); token != keyword)
+				{
+					throw std::runtime_error(std::format("Invalid BPN serialization, expected `{}` instead of `{}`",
+						keyword, token.substr(0, 32)));
+				}
+			}
+
+			// Rest of the current line
+			std::string_view restOfLine() noexcept
+			{
+				std::size_t const end = std::min(m_text.find('\n', m_position), m_text.size());
+				std::string_view const line = m_text.substr(m_position, end - m_position);
+				m_position = end;
+				return line;
+			}
+
+			std::size_t position() const noexcept
+			{
+				return m_position;
+			}
+
+			// Next token, parsed as a number in place
+			double number()
+			{
+				skipSpaces();
+				const char* const begin = m_text.data() + m_position;
+				const char* const last = m_text.data() + m_text.size();
+				double value = 0.0;
+				auto const [end, ec] = std::from_chars(begin, last, value);
+				if (ec != std::errc() || (end < last && !isSpace(*end)))
+				{
+					throw std::runtime_error(std::format("Invalid BPN serialization, expected a number instead of `{}`",
+						next().substr(0, 32)));
+				}
+				m_position = end - m_text.data();
+				return value;
+			}
+
+		private:
+			static bool isSpace(char c) noexcept
+			{
+				return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+			}
+
+			void skipSpaces() noexcept
+			{
+				while (m_position < m_text.size() && isSpace(m_text[m_position]))
+				{
+					++m_position;
+				}
+			}
+
+			std::string_view m_text;
+			std::size_t      m_position = 0;
+		};
+	}
+
 	Network::Network(const std::vector<int>& layerSizes, std::unique_ptr<ActivationFunction>&& sigma, std::string_view labels)
+		: Network(layerSizes,
+			std::vector<std::shared_ptr<const ActivationFunction>>(layerSizes.size() - 1, std::move(sigma)),
+			labels)
+	{
+	}
+
+	Network::Network(const std::vector<int>& layerSizes,
+		std::vector<std::shared_ptr<const ActivationFunction>> activationFunctions,
+		std::string_view labels)
 		: m_layerSizes(layerSizes)
-		, m_sigma(std::move(sigma))
+		, m_activationFunctions(std::move(activationFunctions))
 		, m_labels(labels)
 	{
 		assert(layerSizes.size() >= 3);
+		assert(m_activationFunctions.size() == layerSizes.size() - 1);
 		m_numLayers = m_layerSizes.size();
 		m_numInputs = m_layerSizes[0];
 		m_numOutputs = m_layerSizes[m_numLayers - 1];
@@ -43,47 +141,103 @@ namespace bpn
 		deserialize(is);
 	}
 
+	Network::Network(std::string_view text)
+	{
+		deserialize(text);
+	}
+
 	void Network::InitializeNetwork()
 	{
 		// Create storage and initialize the neurons and the outputs
 		//-------------------------------------------------------------------------
 
-		for (auto layerSize : m_layerSizes)
+		// One arena holds the activations, then the values, then the error
+		// gradients of every layer
+		m_neurons = Arena(neuronArenaSize(m_layerSizes));
+		m_activationOffsets.clear();
+		m_valueOffsets.clear();
+		m_gradientOffsets.clear();
+		std::size_t offset = 0;
+		for (std::vector<std::size_t>* offsets : { &m_activationOffsets, &m_valueOffsets, &m_gradientOffsets })
 		{
-			m_layers.emplace_back(layerSize, Neuron(0, 0));
+			for (int i = 0; i < m_numLayers; ++i)
+			{
+				offsets->push_back(offset);
+				offset += Arena::align((m_layerSizes[i] + 1) * sizeof(double));
+			}
 		}
-		m_inputNeurons = &m_layers[0];
-		m_lastHiddenNeurons = &m_layers[m_numLayers - 2];
-		m_outputNeurons = &m_layers[m_numLayers - 1];
-
 
 		// Add bias values
 		for (int i = 0; i < m_numLayers - 1; ++i)
 		{
-			m_layers[i].emplace_back(1.0, 1.0);
+			activations(i)[m_layerSizes[i]] = 1.0;
+			values(i)[m_layerSizes[i]] = 1.0;
 		}
 
 		// Set the size of clamped output 
 		m_clampedOutputs.resize(m_numOutputs, 0);
+		m_activeInputs.reserve(m_numInputs);
+
+		m_neuronsMemory.update(m_neurons.byteSize()
+			+ m_clampedOutputs.capacity() * sizeof(int32_t)
+			+ m_activeInputs.capacity() * sizeof(int32_t));
 
 		// Create storage and initialize the weights
 		//-------------------------------------------------------------------------
+		m_weightsByLayer.clear();
 		for (int i = 0; i < m_numLayers - 1; ++i)
 		{
 			// add one the the input size for th bias
 			m_weightsByLayer.emplace_back(m_layerSizes[i] + 1, m_layerSizes[i + 1], 0.0);
 		}
 
+		UpdateWeightsMemory();
+	}
+
+	void Network::UpdateWeightsMemory()
+	{
+		std::size_t weightBytes = 0;
+		for (const Matrix& weights : m_weightsByLayer)
+		{
+			weightBytes += weights.byteSize();
+		}
+		for (const std::vector<uint8_t>& mask : m_pruningMasks)
+		{
+			weightBytes += mask.capacity();
+		}
+		for (const std::optional<SparseMatrix>& sparseWeights : m_sparseWeights)
+		{
+			weightBytes += sparseWeights ? sparseWeights->byteSize() : 0;
+		}
+		m_weightsMemory.update(weightBytes);
+	}
+
+	std::size_t Network::neuronArenaSize(const std::vector<int>& layerSizes)
+	{
+		// activations, values and error gradients, plus the bias neuron
+		std::size_t bytes = 0;
+		for (int layerSize : layerSizes)
+		{
+			bytes += 3 * Arena::align((layerSize + 1) * sizeof(double));
+		}
+		return bytes;
+	}
+
+	std::size_t Network::plannedFootprint(const std::vector<int>& layerSizes)
+	{
+		std::size_t bytes = Arena::align(neuronArenaSize(layerSizes));
+		for (std::size_t i = 0; i + 1 < layerSizes.size(); ++i)
+		{
+			bytes += (layerSizes[i] + 1) * layerSizes[i + 1] * sizeof(double);
+		}
+		bytes += (layerSizes.back() + layerSizes.front()) * sizeof(int32_t);
+		return bytes;
 	}
 
 	void Network::InitializeWeights()
 	{
-		// TODO : function ``generator`` initializes a pseudo-random number
-		// generator. Here initialization is hard-coded at 0 for debug reasons
-		// (reproducabiblity is the key... right ?).
-		std::random_device rd;
-		std::mt19937 generator(rd());
-		//std::mt19937 generator( 0 );
+		// Random unless a seed was set, see setRandomSeed
+		std::mt19937 generator(randomSeed(RandomStream::weights));
 
 
 		// Let N be the number of neurons in a given layer. 
@@ -110,72 +264,406 @@ namespace bpn
 		}
 	}
 
-	std::vector<int32_t> const& Network::Evaluate(std::vector<double> const& input)
+	std::vector<int32_t> const& Network::Evaluate(std::span<const double> input)
 	{
 		assert(input.size() == (unsigned int)m_numInputs);
 		for (int i = 0; i < m_numLayers - 1; ++i)
 		{
-			assert(m_layers[i].back().value == 1.0);
+			assert(values(i)[m_layerSizes[i]] == 1.0);
 		}
 
-		// Local variables
-		Layer& inputNeurons = *m_inputNeurons;
+		SetInput(input);
+		EvaluateLayers(0, m_numLayers - 1);
+		return m_clampedOutputs;
+	}
+
+	std::vector<int32_t> const& Network::EvaluateFrom(int32_t layer, std::span<const double> layerValues)
+	{
+		assert(layer > 0 && layer < m_numLayers - 1);
+		assert(layerValues.size() == (unsigned int)m_layerSizes[layer]);
+		std::copy_n(layerValues.data(), m_layerSizes[layer], values(layer));
+		EvaluateLayers(layer, m_numLayers - 1);
+		return m_clampedOutputs;
+	}
 
+	void Network::SetInput(std::span<const double> input)
+	{
 		// Set input values
 		//-------------------------------------------------------------------------
 
-		// Activation function is not applied on the value of input neurons
+		// Activation function is not applied on the value of input neurons.
+		// Non-zero inputs are listed to skip the zero rows of the first layer.
+		std::copy_n(input.data(), m_numInputs, activations(0));
+		std::copy_n(input.data(), m_numInputs, values(0));
+		m_activeInputs.clear();
 		for (int i = 0; i < m_numInputs; ++i)
 		{
-			inputNeurons[i] = Neuron(input[i], input[i]);
+			if (input[i] != 0.0)
+			{
+				m_activeInputs.push_back(i);
+			}
 		}
+		m_sparseInput = m_activeInputs.size() <= SparseInputDensity * m_numInputs;
+	}
 
-		// Update neurons one layer at the time starting from the first hidden
-		// la yer to the output layer.
+	void Network::EvaluateLayers(int32_t first, int32_t last)
+	{
+		// Update neurons one layer at the time starting from the layer after
+		// ``first`` up to ``last``.
 		//-------------------------------------------------------------------------
 
-		for (int32_t i = 1; i < m_numLayers; ++i)
+		for (int32_t i = first + 1; i <= last; ++i)
+		{
+			Matrix const& weights = m_weightsByLayer[i - 1];
+			int32_t const numPrev = m_layerSizes[i - 1];
+			int32_t const numActual = m_layerSizes[i];
+			bool const sparseWeights = m_useSparseWeights && m_sparseWeights[i - 1];
+
+			// Neurons [begin, end) of the layer. The sums of a neuron do not
+			// depend on the range, so a split layer gives the same values.
+			auto evaluateNeurons = [&](int32_t begin, int32_t end)
+			{
+				const double* __restrict prevValues = values(i - 1);
+				double* __restrict actualActivations = activations(i) + begin;
+				const double* rangeWeights = weights.data() + begin;
+				int32_t const count = end - begin;
+
+				// Weighted sums, one contiguous row of weights per previous neuron
+				std::fill_n(actualActivations, count, 0.0);
+				if (sparseWeights)
+				{
+					// Compressed weights of a pruned layer, never split
+					if (i == 1 && m_sparseInput)
+					{
+						m_sparseWeights[i - 1]->multiplyAddRows(m_activeInputs, prevValues, actualActivations);
+					}
+					else
+					{
+						m_sparseWeights[i - 1]->multiplyAdd(prevValues, actualActivations);
+					}
+				}
+				else if (i == 1 && m_sparseInput)
+				{
+					kernels::multiplyTransposedAddRows(rangeWeights, m_activeInputs, prevValues, actualActivations,
+						count, numActual);
+				}
+				else
+				{
+					kernels::multiplyTransposedAdd(rangeWeights, prevValues, actualActivations, numPrev, count, numActual);
+				}
+
+				// Epilogue : add the bias neuron weights (last row) and apply the
+				// activation function of the layer in the same pass
+				const double* biasRow = weights.data() + numPrev * numActual + begin;
+				if (i == m_numLayers - 1 && m_softmaxOutput)
+				{
+					// softmax output is normalized below
+					for (int32_t actualIdx = 0; actualIdx < count; ++actualIdx)
+					{
+						actualActivations[actualIdx] += biasRow[actualIdx];
+					}
+				}
+				else
+				{
+					m_activationFunctions[i - 1]->evaluateLayer(actualActivations, values(i) + begin, biasRow, count);
+				}
+			};
+
+			if (m_threadPool && !sparseWeights
+				&& static_cast<std::size_t>(numPrev) * numActual >= m_parallelLayerWeights)
+			{
+				// One range of whole cache lines of neurons per thread, so that
+				// no two threads write the same line
+				constexpr int32_t neuronsPerLine = 64 / sizeof(double);
+				int32_t const numLines = (numActual + neuronsPerLine - 1) / neuronsPerLine;
+				int32_t const numParts = std::min(m_threadPool->size(), numLines);
+				auto task = [&](int32_t part)
+				{
+					if (part < numParts)
+					{
+						int32_t const begin = std::min(numActual, numLines * part / numParts * neuronsPerLine);
+						int32_t const end = std::min(numActual, numLines * (part + 1) / numParts * neuronsPerLine);
+						evaluateNeurons(begin, end);
+					}
+				};
+				m_threadPool->run(task);
+			}
+			else
+			{
+				evaluateNeurons(0, numActual);
+			}
+		}
+
+		if (last < m_numLayers - 1)
 		{
+			return;
+		}
+		if (m_softmaxOutput)
+		{
+			softmax(activations(m_numLayers - 1), values(m_numLayers - 1), m_numOutputs);
+		}
+		UpdateClampedOutputs();
+	}
 
-			for (int32_t actualIdx = 0; actualIdx < m_layerSizes[i]; ++actualIdx)
+	void Network::UpdateClampedOutputs()
+	{
+		// Check output layer and update clamped outputs
+		const double* outputActivations = activations(m_numLayers - 1);
+		const double* clampedValues = m_softmaxOutput ? values(m_numLayers - 1) : outputActivations;
+		for (int32_t outputIdx = 0; outputIdx < m_numOutputs; ++outputIdx)
+		{
+			if (std::isnan(outputActivations[outputIdx]))
 			{
+				throw std::runtime_error("Training failed. Seem like weights diverged toward infinity");
+			}
+			m_clampedOutputs[outputIdx] = ClampOutputValue(clampedValues[outputIdx]);
+		}
+	}
+
+	void Network::EvaluateBatch(Matrix const& inputs, Matrix& outputs) const
+	{
+		assert(inputs.cols() == m_numInputs);
+		assert(outputs.rows() == inputs.rows() && outputs.cols() == m_numOutputs);
+
+		int32_t const batchSize = inputs.rows();
+		std::optional<Matrix> prevValues(inputs);
+		std::optional<Matrix> actualValues;
+		for (int32_t i = 1; i < m_numLayers; ++i)
+		{
+			Matrix const& weights = m_weightsByLayer[i - 1];
+			int32_t const numPrev = m_layerSizes[i - 1];
+			int32_t const numActual = m_layerSizes[i];
+			actualValues.emplace(batchSize, numActual, 0.0);
 
-				double activation = 0.0;
+			// Weighted sums of the whole batch
+			if (m_useSparseWeights && m_sparseWeights[i - 1])
+			{
+				m_sparseWeights[i - 1]->multiplyAdd(*prevValues, *actualValues);
+			}
+			else
+			{
+				kernels::multiplyTransposedAddBatch(weights.data(), prevValues->data(), actualValues->data(),
+					batchSize, numPrev, numActual, m_batchTiling);
+			}
 
-				// Get weighted sum of pattern and bias neuron
-				for (int32_t prevIdx = 0; prevIdx <= m_layerSizes[i - 1]; ++prevIdx)
+			// Epilogue, in place since only the values are kept
+			const double* biasRow = weights.data() + numPrev * numActual;
+			for (int32_t b = 0; b < batchSize; ++b)
+			{
+				double* y = actualValues->data() + b * numActual;
+				if (i == m_numLayers - 1 && m_softmaxOutput)
+				{
+					for (int32_t actualIdx = 0; actualIdx < numActual; ++actualIdx)
+					{
+						y[actualIdx] += biasRow[actualIdx];
+					}
+					softmax(y, y, numActual);
+				}
+				else
 				{
-					activation += m_layers[i - 1][prevIdx].value * m_weightsByLayer[i - 1](prevIdx, actualIdx);
-					//std::cout << "layer=" << i 
-					//  << ", actualIdx" << actualIdx 
-					//  << ", prevIdx=" << prevIdx 
-					//  << ", activation = " << m_layers[i-1][prevIdx].value 
-					//  << " * " << m_weightsByLayer[i-1](prevIdx, actualIdx) << std::endl;
+					m_activationFunctions[i - 1]->evaluateLayer(y, y, biasRow, numActual);
 				}
+			}
+			prevValues.emplace(std::move(*actualValues));
+		}
 
-				// Apply activation function
-				m_layers[i][actualIdx].activation = activation;
-				m_layers[i][actualIdx].value = m_sigma->evaluate(activation);
+		std::copy_n(prevValues->data(), prevValues->size(), outputs.data());
+	}
 
-				if (std::isnan(m_layers[i][actualIdx].value))
+	void Network::softmax(const double* x, double* fx, std::size_t n)
+	{
+		// Subtract the largest activation so that exp() cannot overflow
+		double maxActivation = x[0];
+		for (std::size_t i = 1; i < n; ++i)
+		{
+			maxActivation = std::max(maxActivation, x[i]);
+		}
+
+		double sum = 0.0;
+		for (std::size_t i = 0; i < n; ++i)
+		{
+			fx[i] = std::exp(x[i] - maxActivation);
+			sum += fx[i];
+		}
+
+		for (std::size_t i = 0; i < n; ++i)
+		{
+			fx[i] /= sum;
+		}
+	}
+
+	double Network::prune(double threshold, double sparsity)
+	{
+		if (sparsity > 0.0)
+		{
+			// Threshold is the ``sparsity`` quantile of the absolute weights
+			std::vector<double> magnitudes;
+			for (int32_t i = 0; i < m_numLayers - 1; ++i)
+			{
+				Matrix const& weights = m_weightsByLayer[i];
+				std::size_t const numWeights = m_layerSizes[i] * weights.cols(); // bias row excluded
+				for (std::size_t k = 0; k < numWeights; ++k)
 				{
-					throw std::runtime_error("Training failed. Seem like weights diverged toward infinity");
+					magnitudes.push_back(std::abs(weights.data()[k]));
 				}
+			}
+			std::size_t const rank = std::min(magnitudes.size() - 1,
+				static_cast<std::size_t>(sparsity * magnitudes.size()));
+			std::nth_element(magnitudes.begin(), magnitudes.begin() + rank, magnitudes.end());
+			threshold = magnitudes[rank];
+		}
 
-				// If this is the output layer (the last layer), then update
-				// clamped outputs
-				if (i == m_numLayers - 1)
+		m_pruningMasks.clear();
+		for (int32_t i = 0; i < m_numLayers - 1; ++i)
+		{
+			Matrix& weights = m_weightsByLayer[i];
+			std::size_t const numWeights = m_layerSizes[i] * weights.cols();
+			std::vector<uint8_t>& mask = m_pruningMasks.emplace_back(weights.size(), uint8_t{ 1 });
+			for (std::size_t k = 0; k < numWeights; ++k)
+			{
+				if (std::abs(weights.data()[k]) < threshold)
 				{
-					m_clampedOutputs[actualIdx] = ClampOutputValue(activation);
+					mask[k] = 0;
 				}
 			}
 		}
+		applyPruningMasks();
+		UpdateWeightsMemory();
+		return getSparsity();
+	}
 
-		return m_clampedOutputs;
+	void Network::applyPruningMasks()
+	{
+		for (std::size_t i = 0; i < m_pruningMasks.size(); ++i)
+		{
+			applyPruningMask(static_cast<int32_t>(i), 0, m_weightsByLayer[i].rows());
+		}
+	}
+
+	void Network::applyPruningMask(int32_t layer, std::size_t beginRow, std::size_t endRow)
+	{
+		std::size_t const numCols = m_weightsByLayer[layer].cols();
+		double* __restrict weights = m_weightsByLayer[layer].data();
+		const uint8_t* __restrict mask = m_pruningMasks[layer].data();
+		for (std::size_t k = beginRow * numCols; k < endRow * numCols; ++k)
+		{
+			weights[k] = mask[k] ? weights[k] : 0.0;
+		}
+	}
+
+	void Network::compressPrunedLayers()
+	{
+		m_sparseWeights.clear();
+		for (int32_t i = 0; i < m_numLayers - 1; ++i)
+		{
+			if (isPruned())
+			{
+				m_sparseWeights.emplace_back(std::in_place, m_weightsByLayer[i], m_layerSizes[i]);
+			}
+			else
+			{
+				m_sparseWeights.emplace_back(std::nullopt);
+			}
+		}
+		m_useSparseWeights = isPruned();
+		UpdateWeightsMemory();
+	}
+
+	double Network::getSparsity() const
+	{
+		std::size_t numZeros = 0;
+		std::size_t numWeights = 0;
+		for (int32_t i = 0; i < m_numLayers - 1; ++i)
+		{
+			Matrix const& weights = m_weightsByLayer[i];
+			std::size_t const n = m_layerSizes[i] * weights.cols();
+			numZeros += std::count(weights.data(), weights.data() + n, 0.0);
+			numWeights += n;
+		}
+		return static_cast<double>(numZeros) / numWeights;
+	}
+
+	void Network::setIntraLayerThreads(int32_t numThreads, std::size_t minLayerWeights)
+	{
+		// Spinning threads sharing a core only slow each other down
+		int32_t const numCores = static_cast<int32_t>(std::thread::hardware_concurrency());
+		if (numCores > 0)
+		{
+			numThreads = std::min(numThreads, numCores);
+		}
+		m_threadPool.reset();
+		if (numThreads > 1)
+		{
+			m_threadPool = std::make_shared<ThreadPool>(numThreads);
+		}
+		m_parallelLayerWeights = minLayerWeights;
+	}
+
+	void Network::Evaluate(std::span<const double> input, std::span<double> output)
+	{
+		assert(output.size() >= (std::size_t)m_numOutputs);
+		Evaluate(input);
+		std::copy_n(values(m_numLayers - 1), m_numOutputs, output.data());
+	}
+
+	std::size_t Network::topK(std::span<const double> input, std::span<int32_t> classes, std::span<double> probabilities)
+	{
+		Evaluate(input);
+
+		// Insertion in the sorted buffers, k is expected to be small
+		std::size_t const k = std::min({ classes.size(), probabilities.size(), (std::size_t)m_numOutputs });
+		const double* outputValues = values(m_numLayers - 1);
+		std::size_t count = 0;
+		for (int32_t outputIdx = 0; outputIdx < m_numOutputs; ++outputIdx)
+		{
+			double const value = outputValues[outputIdx];
+			if (count == k && (k == 0 || value <= probabilities[k - 1]))
+			{
+				continue;
+			}
+
+			std::size_t position = std::min(count, k - 1);
+			while (position > 0 && probabilities[position - 1] < value)
+			{
+				classes[position] = classes[position - 1];
+				probabilities[position] = probabilities[position - 1];
+				--position;
+			}
+			classes[position] = outputIdx;
+			probabilities[position] = value;
+			count = std::min(count + 1, k);
+		}
+		return k;
+	}
+
+	int32_t Network::getPredictedClass() const
+	{
+		const double* outputValues = values(m_numLayers - 1);
+		int32_t predictedClass = 0;
+		for (int32_t outputIdx = 1; outputIdx < m_numOutputs; ++outputIdx)
+		{
+			if (outputValues[outputIdx] > outputValues[predictedClass])
+			{
+				predictedClass = outputIdx;
+			}
+		}
+		return predictedClass;
 	}
 
 	std::string Network::selfDisplay() const
 	{
+		// (activation, value) of every neuron of a layer, bias included
+		auto layerDisplay = [this](int32_t layer)
+		{
+			int32_t const n = m_layerSizes[layer] + (layer < m_numLayers - 1 ? 1 : 0);
+			std::string s = "[";
+			for (int32_t i = 0; i < n; ++i)
+			{
+				s += std::format("{}({}, {})", i > 0 ? ", " : "", activations(layer)[i], values(layer)[i]);
+			}
+			return s + "]";
+		};
+
 		std::ostringstream ss;
 		ss << "+----------------------------------------------------+\n"
 			<< "| Number of input  nodes: " << m_numInputs << '\n'
@@ -196,12 +684,12 @@ namespace bpn
 			<< "|\n"
 			<< "| --- Neurons ---\n"
 			<< "|\n"
-			<< "| Input layer       : " << *m_inputNeurons << "\n";
+			<< "| Input layer       : " << layerDisplay(0) << "\n";
 		for (int32_t i = 1; i < m_numLayers - 1; ++i)
 		{
-			ss << "| Hidden layer #" << i << "   : " << m_layers[i] << "\n";
+			ss << "| Hidden layer #" << i << "   : " << layerDisplay(i) << "\n";
 		}
-		ss << "| Output neurons    : " << *m_outputNeurons << "\n"
+		ss << "| Output neurons    : " << layerDisplay(m_numLayers - 1) << "\n"
 			<< "| Clamp o/p neurons : " << m_clampedOutputs << "\n"
 			<< "+----------------------------------------------------+\n";
 		return ss.str();
@@ -209,23 +697,58 @@ namespace bpn
 
 	void Network::deserialize(std::istream& is)
 	{
-		std::string s;
-		is >> s;
-		if (s.compare("layerSizes") != 0)
+		// Read in one shot, from the current position to the end
+		std::string text;
+		std::istream::pos_type const begin = is.tellg();
+		if (begin != std::istream::pos_type(-1) && is.seekg(0, std::ios::end))
 		{
-			std::cerr << ">>" << s << "<<" << std::endl;
-			throw std::runtime_error("Invalid BPN serialization");
+			text.resize(static_cast<std::size_t>(is.tellg() - begin));
+			is.seekg(begin);
+			is.read(text.data(), text.size());
+			text.resize(static_cast<std::size_t>(is.gcount()));
+
+			// Data after the model is left to the caller
+			std::size_t const length = deserialize(std::string_view(text));
+			is.clear();
+			is.seekg(begin + static_cast<std::streamoff>(length));
+			return;
 		}
-		is >> m_layerSizes;
 
-		is >> s;
-		if (s.compare("activation") != 0)
+		is.clear();
+		text.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+		deserialize(std::string_view(text));
+	}
+
+	std::size_t Network::deserialize(std::string_view text)
+	{
+		TokenReader reader(text);
+
+		reader.expect("layerSizes");
+		m_layerSizes.clear();
+		std::string_view sizes = reader.restOfLine();
+		while (!sizes.empty())
+		{
+			std::size_t const first = sizes.find_first_not_of(" \t\r[],");
+			if (first == std::string_view::npos)
+			{
+				break;
+			}
+			int size = 0;
+			auto const [end, ec] = std::from_chars(sizes.data() + first, sizes.data() + sizes.size(), size);
+			if (ec != std::errc())
+			{
+				throw std::runtime_error(std::format("Invalid BPN serialization, layer sizes `{}`", sizes));
+			}
+			m_layerSizes.push_back(size);
+			sizes.remove_prefix(end - sizes.data());
+		}
+		if (m_layerSizes.size() < 2 || std::ranges::any_of(m_layerSizes, [](int size) { return size <= 0; }))
 		{
-			std::cerr << ">>" << s << "<<" << std::endl;
-			throw std::runtime_error("Invalid BPN serialization");
+			throw std::runtime_error("Invalid BPN serialization, layer sizes");
 		}
-		is >> s;
-		m_sigma = ActivationFunction::deserialize(s);
+
+		reader.expect("activation");
+		m_activationFunctions = ActivationFunction::deserializeList(reader.next(), m_layerSizes.size() - 1);
 
 		m_numLayers = m_layerSizes.size();
 		m_numInputs = m_layerSizes[0];
@@ -234,43 +757,55 @@ namespace bpn
 
 		InitializeNetwork();
 
-		// Read weights
-		is >> s;
-		if (s.compare("weights") != 0)
+		// Weights, in the row major order of the matrices
+		reader.expect("weights");
+		for (Matrix& weights : m_weightsByLayer)
 		{
-			std::cerr << ">>" << s << "<<" << std::endl;
-			throw std::runtime_error("Invalid BPN serialization");
+			double* const data = weights.data();
+			for (std::size_t i = 0; i < weights.size(); ++i)
+			{
+				data[i] = reader.number();
+			}
 		}
-		for (int32_t i = 0; i < m_numLayers - 1; ++i)
+
+		// Output normalization and labels (optional)
+		m_softmaxOutput = false;
+		m_labels = std::string(""); // no labels
+		std::size_t end = reader.position();
+		for (std::string_view token = reader.next(); !token.empty(); token = reader.next())
 		{
-			for (int32_t actualIdx = 0; actualIdx <= m_layerSizes[i]; ++actualIdx)
+			if (token == "output")
 			{
-				for (int32_t nextIdx = 0; nextIdx < m_layerSizes[i + 1]; ++nextIdx)
-				{
-					double d;
-					is >> d;
-					m_weightsByLayer[i](actualIdx, nextIdx) = d;
-				}
+				m_softmaxOutput = reader.next() == "Softmax";
+			}
+			else if (token == "labels")
+			{
+				m_labels = reader.next();
+			}
+			else
+			{
+				break;
 			}
+			end = reader.position();
 		}
 
-		// Read labels (optionnal)
-		is >> s;
-		if (s.compare("labels") != 0)
+		// The model ends with its last line break
+		if (end < text.size() && text[end] == '\r')
 		{
-			m_labels = std::string(""); // no labels
+			++end;
 		}
-		else
+		if (end < text.size() && text[end] == '\n')
 		{
-			is >> m_labels;
+			++end;
 		}
+		return end;
 	}
 
 	std::string Network::serialize() const
 	{
 		std::stringstream ss;
 		ss << "layerSizes " << m_layerSizes << '\n';
-		ss << "activation " << m_sigma->serialize() << '\n';
+		ss << "activation " << activationFunctionName() << '\n';
 		ss << "weights";
 		for (int32_t i = 0; i < m_numLayers - 1; ++i)
 		{
@@ -283,6 +818,10 @@ namespace bpn
 			}
 		}
 		ss << '\n';
+		if (m_softmaxOutput)
+		{
+			ss << "output Softmax\n";
+		}
 		if (m_labels.length() > 0)
 		{
 			ss << "labels " << m_labels << '\n';
@@ -305,10 +844,4 @@ namespace bpn
 		os << n.selfDisplay();
 		return os;
 	}
-
-	std::ostream& operator<<(std::ostream& os, const bpn::Neuron& n)
-	{
-		os << std::format("({}, {})", n.activation, n.value);
-		return os;
-	}
 }
\ No newline at end of file
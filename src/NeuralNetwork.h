@@ -10,24 +10,22 @@
 #pragma once
 
 #include "ActivationFunctions.h"
+#include "Arena.h"
+#include "Kernels.h"
 #include "Matrix.h"
+#include "MemoryTracker.h"
+#include "SparseMatrix.h"
+#include "ThreadPool.h"
 #include "vectorstream.h"
 #include <iostream>
 #include <stdint.h>
 #include <vector>
 #include <memory>
+#include <optional>
+#include <span>
 
 namespace bpn
 {
-	struct Neuron
-	{
-		Neuron() noexcept : activation{}, value{} {}
-		Neuron(double a, double v) noexcept : activation{ a }, value{ v } {}
-		double activation;
-		double value; // = Sigma(activation)
-		friend std::ostream& operator<<(std::ostream& os, const bpn::Neuron& n);
-	};
-
 	class Network
 	{
 		friend class NetworkTrainer;
@@ -41,16 +39,124 @@ namespace bpn
 			else return -1;
 		}
 
+		// Inputs with at most this fraction of non-zero values take the sparse
+		// path of the first layer.
+		static constexpr double SparseInputDensity = 0.5;
+
 	public:
+		// Layers with fewer weights are not worth splitting between threads
+		static constexpr std::size_t DefaultParallelLayerWeights = 1 << 16;
+
 		Network(const std::vector<int>& layerSizes, std::unique_ptr<ActivationFunction>&& sigma, std::string_view labels);
+		// activationFunctions[i] is applied on layer i+1 (none on the input layer)
+		Network(const std::vector<int>& layerSizes,
+			std::vector<std::shared_ptr<const ActivationFunction>> activationFunctions,
+			std::string_view labels);
+		// Network serialized in ``is``, which is left right after the model
+		// when it can seek, and read to its end otherwise
 		Network(std::istream& is);
+		// Network serialized in ``text``, see deserialize
+		explicit Network(std::string_view text);
+
+		// Evaluations reuse the neurons of the network : a network must not
+		// be evaluated by several threads at once. They do not allocate.
+		std::vector<int32_t> const& Evaluate(std::span<const double> input);
+
+		/**
+		 * Evaluates ``input`` and writes the output values in ``output``
+		 * (numOutputs values).
+		 */
+		void Evaluate(std::span<const double> input, std::span<double> output);
+
+		/**
+		 * Evaluates ``input`` and writes the ``k`` output neurons with the
+		 * largest values in ``classes``, best first, and their values
+		 * (probabilities with a softmax output) in ``probabilities``. ``k``
+		 * is the smallest of the two buffer sizes and numOutputs, returns k.
+		 */
+		std::size_t topK(std::span<const double> input, std::span<int32_t> classes, std::span<double> probabilities);
+
+		/**
+		 * Evaluates every row of ``inputs`` (batch x numInputs) and writes the
+		 * output values in ``outputs`` (batch x numOutputs).
+		 */
+		void EvaluateBatch(Matrix const& inputs, Matrix& outputs) const;
+
+		// Block sizes of the batch evaluations, the outputs do not depend on them
+		inline void setBatchTiling(kernels::BatchTiling batchTiling)
+		{
+			m_batchTiling = batchTiling;
+		}
+
+		inline kernels::BatchTiling getBatchTiling() const
+		{
+			return m_batchTiling;
+		}
+
+		/**
+		 * Magnitude pruning : sets to 0, for good, every weight (bias weights
+		 * excluded) whose absolute value is below ``threshold``. When
+		 * ``sparsity`` is positive, the threshold is instead chosen so that
+		 * this fraction of the weights is pruned. Returns the resulting
+		 * sparsity.
+		 */
+		double prune(double threshold, double sparsity);
+
+		// Sets back to 0 the pruned weights (e.g. after an update)
+		void applyPruningMasks();
 
-		std::vector<int32_t> const& Evaluate(std::vector<double> const& input);
+		// Same, for the rows [beginRow, endRow) of the weights of ``layer`` only
+		void applyPruningMask(int32_t layer, std::size_t beginRow, std::size_t endRow);
+
+		/**
+		 * Builds the compressed sparse row copy of the weights of every
+		 * pruned layer. Evaluations use it until the next call to
+		 * ``setUseSparseWeights(false)``.
+		 */
+		void compressPrunedLayers();
+
+		/**
+		 * Splits the neurons of every layer with at least ``minLayerWeights``
+		 * weights between ``numThreads`` threads, the calling one included,
+		 * in Evaluate, at most one per core. The outputs are the same as on one thread. Pruned
+		 * layers using their compressed weights stay on the calling thread.
+		 * Copies of the network share the threads.
+		 */
+		void setIntraLayerThreads(int32_t numThreads, std::size_t minLayerWeights = DefaultParallelLayerWeights);
+
+		inline int32_t getIntraLayerThreads() const
+		{
+			return m_threadPool ? m_threadPool->size() : 1;
+		}
+
+		inline void setUseSparseWeights(bool useSparseWeights)
+		{
+			m_useSparseWeights = useSparseWeights;
+		}
+
+		inline bool isPruned() const
+		{
+			return !m_pruningMasks.empty();
+		}
+
+		// Fraction of the weights (bias weights excluded) equal to 0
+		double getSparsity() const;
 
 		void saveToFile(const char* filename) const;
 
 		std::string serialize() const;
+		// Reads the rest of ``is`` at once, then parses it as the string_view
+		// overload. A stream that can seek is then moved right after the model.
 		void deserialize(std::istream& is);
+		// Parses the output of ``serialize`` in place, throws if it is invalid.
+		// Returns the length of the model, which may be followed by other data.
+		std::size_t deserialize(std::string_view text);
+
+		/**
+		 * Bytes that a network with the given layer sizes will hold once
+		 * initialized (weights and neurons).
+		 */
+		static std::size_t plannedFootprint(const std::vector<int>& layerSizes);
 
 		inline int32_t getNumInputs() const
 		{
@@ -64,7 +170,7 @@ namespace bpn
 
 		inline int32_t getNumLayers() const
 		{
-			return m_layers.size();
+			return m_numLayers;
 		}
 
 		inline const std::vector<int>& getLayerSizes() const
@@ -74,33 +180,119 @@ namespace bpn
 
 		inline double getValue(int layer, int n) const
 		{
-			return m_layers[layer][n].value;
+			return values(layer)[n];
+		}
+
+		inline double getActivation(int layer, int n) const
+		{
+			return activations(layer)[n];
 		}
 
 		inline const std::string activationFunctionName() const
 		{
-			return m_sigma->serialize();
+			return ActivationFunction::serializeList(m_activationFunctions);
+		}
+
+		// Weights from ``layer`` to ``layer + 1``, the last row being the bias neuron
+		inline const Matrix& getWeights(int layer) const
+		{
+			return m_weightsByLayer[layer];
+		}
+
+		// Activation function applied on ``layer`` (layer >= 1)
+		inline const ActivationFunction& activationFunction(int layer) const
+		{
+			return *m_activationFunctions[layer - 1];
 		}
 
+		/**
+		 * When enabled, the output layer is normalized with a softmax instead
+		 * of the activation function, so that outputs sum to 1.
+		 */
+		inline void setSoftmaxOutput(bool softmaxOutput)
+		{
+			m_softmaxOutput = softmaxOutput;
+		}
+
+		inline bool hasSoftmaxOutput() const
+		{
+			return m_softmaxOutput;
+		}
+
+		/**
+		 * Index of the output neuron with the largest value.
+		 */
+		int32_t getPredictedClass() const;
+
 		inline const std::vector<int32_t>& getOutput() const
 		{
 			return m_clampedOutputs;
 		}
 
-		inline const std::vector<double> getUnClampedOutput() const
+		// Output values of the last evaluation, valid until the next one
+		inline std::span<const double> getUnClampedOutput() const
 		{
-			std::vector<double> t;
-			for (int i = 0; i < m_numOutputs; ++i)
-			{
-				t.push_back(m_outputNeurons->at(i).value);
-			}
-			return t;
+			return { values(m_numLayers - 1), static_cast<std::size_t>(m_numOutputs) };
 		}
 
 	private:
 		void loadFromFile(const char* filename);
 		void InitializeNetwork();
 		void InitializeWeights();
+		void UpdateWeightsMemory();
+
+		// Copies ``input`` in the input layer and lists its non-zero values
+		void SetInput(std::span<const double> input);
+
+		/**
+		 * Evaluates the layers after ``first``, whose values are set, up to
+		 * ``last``. The outputs are updated when ``last`` is the output layer.
+		 */
+		void EvaluateLayers(int32_t first, int32_t last);
+
+		/**
+		 * Evaluates the network from the values of the hidden ``layer``
+		 * (e.g. cached by the trainer for frozen layers), the layers below
+		 * being left as they are.
+		 */
+		std::vector<int32_t> const& EvaluateFrom(int32_t layer, std::span<const double> layerValues);
+
+		// Checks the output layer once evaluated and updates the clamped outputs
+		void UpdateClampedOutputs();
+
+		// Neuron arrays of ``layer``, the bias neuron (value 1) is the last
+		// element of every non output layer
+		inline double* activations(int layer)
+		{
+			return m_neurons.get<double>(m_activationOffsets[layer]);
+		}
+
+		inline const double* activations(int layer) const
+		{
+			return m_neurons.get<double>(m_activationOffsets[layer]);
+		}
+
+		inline double* values(int layer)
+		{
+			return m_neurons.get<double>(m_valueOffsets[layer]);
+		}
+
+		inline const double* values(int layer) const
+		{
+			return m_neurons.get<double>(m_valueOffsets[layer]);
+		}
+
+		// Error gradients of ``layer``, filled during back-propagation
+		inline double* errorGradients(int layer)
+		{
+			return m_neurons.get<double>(m_gradientOffsets[layer]);
+		}
+
+		// Bytes of the neuron arena, every array starting on a cache line
+		static std::size_t neuronArenaSize(const std::vector<int>& layerSizes);
+
+		// fx[i] = exp(x[i]) / sum_j exp(x[j])
+		static void softmax(const double* x, double* fx, std::size_t n);
 
 	private:
 
@@ -109,17 +301,37 @@ namespace bpn
 		int32_t                     m_numOutputs;      // number of neurons on the output layer
 		int32_t                     m_numOnLastHidden; // number of neurons on the last hidden layer
 		std::vector<int>            m_layerSizes;      // m_layerSizes[i] is the number of neurons on the i-th layer.
-		using Layer = std::vector<Neuron>;
-		std::vector<Layer>          m_layers;           // m_layers[i] is the i-th layer
-		Layer* m_inputNeurons;      // &m_layers[0]
-		Layer* m_lastHiddenNeurons; // &m_layers[-2] (python notations)
-		Layer* m_outputNeurons;     // &m_layers[-1]
+		// Activations, values and error gradients of every layer, as separate
+		// arrays carved from one arena allocated at initialization.
+		// m_activationOffsets[i] is the byte offset of the activations of the
+		// i-th layer, and so on.
+		Arena                       m_neurons;
+		std::vector<std::size_t>    m_activationOffsets;
+		std::vector<std::size_t>    m_valueOffsets;
+		std::vector<std::size_t>    m_gradientOffsets;
 		std::vector<int32_t>        m_clampedOutputs;
+		std::vector<int32_t>        m_activeInputs;    // indices of the non-zero inputs of the last evaluation
+		bool                        m_sparseInput = false; // m_activeInputs is sparse enough to be used
 		// m_wrigntsByLayer[i] is the matrix of weights from layer i to layer i+1
 		std::vector<Matrix>         m_weightsByLayer;
-		std::unique_ptr<const ActivationFunction> m_sigma;
+		// m_pruningMasks[i](j,k) is 0 when the weight from j to k was pruned,
+		// empty when the network is not pruned
+		std::vector<std::vector<uint8_t>> m_pruningMasks;
+		// m_sparseWeights[i] is the CSR copy of m_weightsByLayer[i] without its bias row
+		std::vector<std::optional<SparseMatrix>> m_sparseWeights;
+		bool                        m_useSparseWeights = false;
+		// Threads of Evaluate, none when it runs on the calling thread only
+		std::shared_ptr<ThreadPool> m_threadPool;
+		std::size_t                 m_parallelLayerWeights = DefaultParallelLayerWeights; // smallest layer split between threads
+		kernels::BatchTiling        m_batchTiling;     // block sizes of EvaluateBatch
+		// m_activationFunctions[i] is applied on layer i+1
+		std::vector<std::shared_ptr<const ActivationFunction>> m_activationFunctions;
+		bool                        m_softmaxOutput = false; // normalize output layer with softmax
 		std::string                 m_labels;          // labels for the output nodes
 
+		MemoryTracker::Registration m_weightsMemory{ MemoryTracker::Category::weights };
+		MemoryTracker::Registration m_neuronsMemory{ MemoryTracker::Category::neurons };
+
 	public:
 
 		std::string selfDisplay() const;
@@ -7,22 +7,78 @@
 
 #include "NeuralNetworkTrainer.h"
 #include "StopWatcher.h"
+#include "Kernels.h"
+#include "Pipeline.h"
+#include "Random.h"
 #include <string.h>
 #include <assert.h>
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <format>
+#include <limits>
+#include <chrono>
+#include <mutex>
+#include <ranges>
+#include <string>
+#include <thread>
 
 //-------------------------------------------------------------------------
 
 namespace bpn
 {
+	void TrainingData::updateMemory()
+	{
+		std::size_t bytes = 0;
+		for (TrainingSet const* set : { &m_trainingSet, &m_generalizationSet, &m_validationSet })
+		{
+			bytes += set->capacity() * sizeof(TrainingEntry);
+			for (TrainingEntry const& entry : *set)
+			{
+				bytes += entry.m_inputs.capacity() * sizeof(double)
+					+ entry.m_expectedOutputs.capacity() * sizeof(int32_t);
+			}
+		}
+		m_memory.update(bytes);
+	}
+
+	//-------------------------------------------------------------------------
+
 	NetworkTrainer::NetworkTrainer(Settings const& settings, Network* pNetwork)
 		: m_pNetwork(pNetwork)
 		, m_learningRate(settings.m_learningRate)
 		, m_momentum(settings.m_momentum)
 		, m_desiredAccuracy(settings.m_desiredAccuracy)
 		, m_maxEpochs(settings.m_maxEpochs)
+		, m_patience(settings.m_patience)
 		, m_useBatchLearning(settings.m_useBatchLearning)
+		, m_miniBatchSize(settings.m_useBatchLearning ? settings.m_miniBatchSize : 0)
+		, m_pCommunicator(nullptr)
+		, m_pipelineStages(settings.m_useBatchLearning
+			? std::clamp<int32_t>(settings.m_pipelineStages, 1, pNetwork->m_numLayers - 1) : 1)
+		, m_pipelineMicroBatch(std::max<int32_t>(settings.m_pipelineMicroBatch, 1))
+		, m_pipelineGPipe(settings.m_pipelineSchedule == "GPipe")
+		, m_reductionQuantum(settings.m_deterministicReduction ? ReductionQuantum : 0.0)
+		, m_frozenLayers(std::clamp<int32_t>(settings.m_frozenLayers, 0, pNetwork->m_numLayers - 2))
+		, m_optimizer(Optimizer::deserialize(settings.m_optimizer, settings.m_learningRate, settings.m_momentum))
+		, m_schedule(LearningRateSchedule::deserialize(settings.m_learningRateSchedule,
+			settings.m_learningRate, settings.m_maxEpochs, settings.m_warmupEpochs))
+		, m_loss(LossFunction::deserialize(settings.m_loss))
+		, m_step(0)
+		, m_importanceSampling(std::max(settings.m_importanceSampling, 0.0))
+		, m_importanceGenerator(randomSeed(RandomStream::importance))
+		, m_pTeacher(nullptr)
+		, m_teacherWeight(0.0)
+		, m_pDistilledSet(nullptr)
+		, m_bestEpoch(0)
+		, m_bestGeneralizationMSE(0)
+		, m_epochsWithoutImprovement(0)
+		, m_finished(false)
 		, m_currentEpoch(0)
+		, m_epochOffset(0)
+		, m_resumeSchedule(settings.m_resumeSchedule)
 		, m_trainingSetAccuracy(0)
 		, m_validationSetAccuracy(0)
 		, m_generalizationSetAccuracy(0)
@@ -32,7 +88,28 @@ namespace bpn
 		, m_verbosity(settings.m_verbosity)
 	{
 		assert(pNetwork != nullptr);
-		for (int32_t i = 0; i < m_pNetwork->m_numLayers - 1; ++i)
+		if (settings.m_pipelineSchedule != "GPipe" && settings.m_pipelineSchedule != "1F1B")
+		{
+			throw std::runtime_error(std::format("Unknown pipeline schedule `{}`", settings.m_pipelineSchedule));
+		}
+		if (m_frozenLayers > 0 && m_pipelineStages > 1)
+		{
+			throw std::runtime_error("Frozen layers are not supported by pipeline parallel training");
+		}
+		m_pNetwork->setSoftmaxOutput(m_loss->usesSoftmaxOutput());
+		if (std::unique_ptr<Augmenter> augmenter = Augmenter::deserialize(settings.m_augmentation, m_pNetwork->m_numInputs))
+		{
+			// A few chunks per thread keep the workers busy while the
+			// network trains on the current one
+			int32_t const numThreads = std::max(settings.m_augmentationThreads, 1);
+			m_augmentation = std::make_unique<AugmentationPipeline>(std::move(augmenter), numThreads,
+				AugmentationChunksPerThread * numThreads);
+		}
+		if (m_importanceSampling > 0.0 && (m_pipelineStages > 1 || m_augmentation))
+		{
+			throw std::runtime_error("Importance sampling is not supported by pipeline parallel training and augmentation");
+		}
+		for (int32_t i = 0; m_useBatchLearning && i < m_pNetwork->m_numLayers - 1; ++i)
 		{
 			// Generate the delta matrix from later i to layer i+1
 			// add one to actualLayerSize for bias
@@ -40,23 +117,137 @@ namespace bpn
 			int32_t nextLayerSize = m_pNetwork->m_layerSizes[i + 1];
 			m_deltas.emplace_back(actualLayerSize + 1, nextLayerSize, 0.0);
 		}
+		m_optimizer->initialize(m_pNetwork->m_weightsByLayer);
+		m_rowLastStep.resize(m_pNetwork->m_numInputs + 1, 0);
 
-		// m_errorGradients[0] is not used... dummy value to fill the spot
-		m_errorGradients.push_back(std::vector<double>());
-		for (int32_t i = 1; i < m_pNetwork->m_numLayers; ++i)
+		std::size_t stateBytes = 0;
+		for (const Matrix& deltas : m_deltas)
 		{
-			int layerSize = m_pNetwork->m_layerSizes[i];
-			if (i < m_pNetwork->m_numLayers - 1)
-			{
-				layerSize += 1; // add one for bias
-			}
-			m_errorGradients.push_back(std::vector<double>());
-			m_errorGradients[i].resize(layerSize, 0.0);
+			stateBytes += deltas.byteSize();
+		}
+		stateBytes += m_optimizer->stateBytes();
+		stateBytes += m_rowLastStep.capacity() * sizeof(uint64_t);
+		m_stateMemory.update(stateBytes);
+	}
+
+	NetworkTrainer::~NetworkTrainer()
+	{
+		StopPipeline();
+	}
+
+	std::size_t NetworkTrainer::plannedFootprint(const std::vector<int>& layerSizes, Settings const& settings,
+		std::size_t numEntries, bool distillation)
+	{
+		// deltas, the optimizer state buffers and the best weights, all shaped
+		// as the weights
+		std::size_t const weightShapedBuffers = (settings.m_useBatchLearning ? 1 : 0) + (settings.m_patience > 0 ? 1 : 0)
+			+ Optimizer::deserialize(settings.m_optimizer, 0.0, 0.0)->numStateBuffers();
+		std::size_t bytes = 0;
+		for (std::size_t i = 0; i + 1 < layerSizes.size(); ++i)
+		{
+			bytes += weightShapedBuffers * (layerSizes[i] + 1) * layerSizes[i + 1] * sizeof(double);
+		}
+		bytes += (layerSizes.front() + 1) * sizeof(uint64_t); // lazy updates of the first layer
+
+		// Per entry : values of the last frozen layer and distillation targets
+		int32_t const frozenLayers = std::clamp<int32_t>(settings.m_frozenLayers, 0, static_cast<int32_t>(layerSizes.size()) - 2);
+		if (frozenLayers > 0)
+		{
+			bytes += numEntries * layerSizes[frozenLayers] * sizeof(double);
+		}
+		if (distillation)
+		{
+			bytes += numEntries * layerSizes.back() * sizeof(double);
+		}
+
+		if (settings.m_augmentation != "none")
+		{
+			std::size_t const numChunks = AugmentationChunksPerThread * std::max(settings.m_augmentationThreads, 1);
+			bytes += numChunks * AugmentationPipeline::ChunkSize * layerSizes.front() * sizeof(double);
+		}
+		return bytes;
+	}
+
+	void NetworkTrainer::setCommunicator(Communicator* pCommunicator)
+	{
+		assert(pCommunicator == nullptr || (m_useBatchLearning && m_pipelineStages == 1));
+		m_pCommunicator = pCommunicator;
+	}
+
+	std::size_t NetworkTrainer::communicationSize(const std::vector<int>& layerSizes)
+	{
+		// Error gradients of every layer, or the 3 epoch statistics
+		std::size_t gradients = 0;
+		for (std::size_t i = 0; i + 1 < layerSizes.size(); ++i)
+		{
+			gradients += static_cast<std::size_t>(layerSizes[i] + 1) * layerSizes[i + 1];
+		}
+		return std::max<std::size_t>(3, gradients);
+	}
+
+	void NetworkTrainer::setTeacher(Network* pTeacher, double teacherWeight)
+	{
+		if (pTeacher && pTeacher->m_numOutputs != m_pNetwork->m_numOutputs)
+		{
+			throw std::runtime_error(std::format("The teacher has {} outputs instead of {}",
+				pTeacher->m_numOutputs, m_pNetwork->m_numOutputs));
+		}
+		if (pTeacher && (m_pipelineStages > 1 || m_augmentation))
+		{
+			throw std::runtime_error("Distillation is not supported by pipeline parallel training and augmentation");
+		}
+		m_pTeacher = pTeacher;
+		m_teacherWeight = std::clamp(teacherWeight, 0.0, 1.0);
+		m_pDistilledSet = nullptr;
+		m_distillationTargets.reset();
+		m_distillationMemory.update(0);
+	}
+
+	void NetworkTrainer::saveOptimizerState(std::string const& path) const
+	{
+		std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+		m_optimizer->saveState(file);
+		uint64_t const epochs = m_epochOffset + m_currentEpoch;
+		file.write(reinterpret_cast<const char*>(&epochs), sizeof(epochs));
+		if (!file.flush())
+		{
+			throw std::runtime_error(std::format("Unable to write the optimizer state `{}`", path));
+		}
+	}
+
+	void NetworkTrainer::loadOptimizerState(std::string const& path)
+	{
+		std::ifstream file(path, std::ios::in | std::ios::binary);
+		if (!file.is_open())
+		{
+			throw std::runtime_error(std::format("Unable to read the optimizer state `{}`", path));
+		}
+		m_optimizer->loadState(file);
+
+		// Absent from the states saved before it was added
+		uint64_t epochs = 0;
+		if (file.read(reinterpret_cast<char*>(&epochs), sizeof(epochs)))
+		{
+			m_epochOffset = epochs;
 		}
 
+		// A schedule which already ended (e.g. a cosine resumed after as many
+		// epochs as its length) would train nothing
+		if (m_resumeSchedule && m_maxEpochs > 0 && m_schedule->learningRate(m_epochOffset + m_maxEpochs - 1) <= 0.0)
+		{
+			throw std::runtime_error(std::format("The learning rate schedule `{}` has no learning rate left after "
+				"the {} epochs of the optimizer state `{}`", m_schedule->serialize(), m_epochOffset, path));
+		}
 	}
 
 	void NetworkTrainer::Train(TrainingData const& trainingData)
+	{
+		BeginTraining();
+		TrainEpochs(trainingData, m_maxEpochs);
+		EndTraining(trainingData);
+	}
+
+	void NetworkTrainer::BeginTraining()
 	{
 		// Reset training state
 		m_currentEpoch = 0;
@@ -66,6 +257,12 @@ namespace bpn
 		m_trainingSetMSE = 0;
 		m_validationSetMSE = 0;
 		m_generalizationSetMSE = 0;
+		m_bestEpoch = 0;
+		m_bestGeneralizationMSE = std::numeric_limits<double>::infinity();
+		m_epochsWithoutImprovement = 0;
+		m_finished = false;
+		m_sampleLosses.clear();
+		ClearFrozenFeatures();
 
 		// Print header
 		//-------------------------------------------------------------------------
@@ -77,30 +274,78 @@ namespace bpn
 				<< std::endl
 				<< " Learning Rate: " << m_learningRate
 				<< ", Momentum: " << m_momentum
+				<< ", Optimizer: " << m_optimizer->serialize()
 				<< ", Max Epochs: " << m_maxEpochs << std::endl
+				<< " Learning Rate Schedule: " << m_schedule->serialize()
+				<< ", Warmup Epochs: " << m_schedule->warmupEpochs
+				<< ", Early Stopping Patience: " << m_patience << std::endl
 				<< " Target Accucaty: " << m_desiredAccuracy
 				<< ", Layers Sizes: " << m_pNetwork->m_layerSizes << std::endl
-				<< " Activation function: " << m_pNetwork->activationFunctionName() << std::endl
-				<< "=========================================================================="
+				<< " Activation function: " << m_pNetwork->activationFunctionName()
+				<< ", Loss function: " << m_loss->serialize() << std::endl
+				<< " Mini-batch size: " << (m_miniBatchSize > 0 ? std::to_string(m_miniBatchSize) : "epoch")
+				<< ", Processes: " << (m_pCommunicator ? m_pCommunicator->size() : 1) << std::endl
+				<< " Augmentation: " << (m_augmentation ? m_augmentation->augmenter().serialize() : "none");
+			if (m_augmentation)
+			{
+				std::cout << " (" << m_augmentation->numThreads() << " threads)";
+			}
+			std::cout << std::endl;
+			if (m_frozenLayers > 0)
+			{
+				std::cout << " Frozen layers of weights: 0-" << m_frozenLayers - 1
+					<< (m_augmentation ? " (recomputed for the augmented entries)" : " (outputs cached)") << std::endl;
+			}
+			if (m_importanceSampling > 0.0)
+			{
+				std::cout << " Importance sampling: " << m_importanceSampling * 100.0
+					<< "% of the training set per epoch" << std::endl;
+			}
+			if (m_pipelineStages > 1)
+			{
+				std::vector<int32_t> const firstLayers = partitionLayers(m_pNetwork->m_layerSizes, m_pipelineStages);
+				std::cout << " Pipeline stages: " << m_pipelineStages << " (layers of weights";
+				for (int32_t stage = 0; stage < m_pipelineStages; ++stage)
+				{
+					std::cout << (stage == 0 ? " " : " | ") << firstLayers[stage] << "-" << firstLayers[stage + 1] - 1;
+				}
+				std::cout << "), Micro-batch size: " << m_pipelineMicroBatch
+					<< ", Schedule: " << (m_pipelineGPipe ? "GPipe" : "1F1B") << std::endl;
+			}
+			std::cout << "=========================================================================="
 				<< std::endl << std::endl;
 		}
+	}
 
+	bool NetworkTrainer::TrainEpochs(TrainingData const& trainingData, uint64_t epochs)
+	{
 		// Train network using training dataset for training and generalization dataset for testing
 		//--------------------------------------------------------------------------------------------------------
 
-		while ((!StopWatcher::stopRequested()) &&
-			((m_trainingSetAccuracy < m_desiredAccuracy
-				|| m_generalizationSetAccuracy < m_desiredAccuracy)
-				&& m_currentEpoch < m_maxEpochs)
-			)
+		auto targetReached = [&]()
 		{
+			return m_currentEpoch >= m_maxEpochs
+				|| (m_trainingSetAccuracy >= m_desiredAccuracy && m_generalizationSetAccuracy >= m_desiredAccuracy);
+		};
+
+		for (uint64_t epoch = 0; epoch < epochs && !m_finished; ++epoch)
+		{
+			if (StopRequested() || targetReached())
+			{
+				m_finished = true;
+				break;
+			}
+
+			m_optimizer->setLearningRate(m_schedule->learningRate(scheduleEpoch()));
+
 			// Use training set to train network
 			RunEpoch(trainingData.m_trainingSet);
 
 			// Get generalization set accuracy and MSE
 			GetSetAccuracyAndMSE(trainingData.m_generalizationSet,
 				m_generalizationSetAccuracy,
-				m_generalizationSetMSE);
+				m_generalizationSetMSE,
+				FrozenFeatures(trainingData.m_generalizationSet));
 
 			if (m_verbosity >= 1)
 			{
@@ -109,10 +354,48 @@ namespace bpn
 					<< " Training Set Accuracy: " << m_trainingSetAccuracy
 					<< "%, MSE: " << m_trainingSetMSE
 					<< ". Generalization Set Accuracy:" << m_generalizationSetAccuracy
-					<< "%, MSE: " << m_generalizationSetMSE << std::endl;
+					<< "%, MSE: " << m_generalizationSetMSE
+					<< ", LR: " << m_optimizer->learningRate() << std::endl;
 			}
 
 			m_currentEpoch++;
+
+			// Early stopping on generalization MSE plateau
+			if (m_patience > 0)
+			{
+				if (m_generalizationSetMSE < m_bestGeneralizationMSE)
+				{
+					m_bestGeneralizationMSE = m_generalizationSetMSE;
+					m_bestEpoch = m_currentEpoch - 1;
+					m_epochsWithoutImprovement = 0;
+					SaveBestWeights();
+				}
+				else if (++m_epochsWithoutImprovement >= m_patience)
+				{
+					if (m_verbosity >= 1)
+					{
+						std::cout << "No improvement of the generalization MSE for "
+							<< m_patience << " epochs, stopping." << std::endl;
+					}
+					m_finished = true;
+				}
+			}
+		}
+		m_finished = m_finished || targetReached();
+		return !m_finished;
+	}
+
+	void NetworkTrainer::EndTraining(TrainingData const& trainingData)
+	{
+		// Roll back to the best weights seen
+		if (m_patience > 0 && !m_bestWeights.empty() && m_bestEpoch + 1 < m_currentEpoch)
+		{
+			RestoreBestWeights();
+			if (m_verbosity >= 1)
+			{
+				std::cout << "Restored weights of epoch " << m_bestEpoch
+					<< " (generalization MSE: " << m_bestGeneralizationMSE << ")" << std::endl;
+			}
 		}
 
 		// Get validation set accuracy and MSE
@@ -125,69 +408,295 @@ namespace bpn
 			std::cout << " Validation Set Accuracy: " << m_validationSetAccuracy << std::endl;
 			std::cout << " Validation Set MSE: " << m_validationSetMSE << std::endl << std::endl;
 		}
+
+		if (m_pTeacher && m_verbosity >= 1 && !trainingData.m_validationSet.empty())
+		{
+			ReportDistillation(trainingData.m_validationSet);
+		}
+	}
+
+	void NetworkTrainer::Prune(TrainingData const& trainingData, double threshold, double sparsity, uint64_t retrainEpochs)
+	{
+		TrainingSet const& validationSet = trainingData.m_validationSet;
+		if (validationSet.empty())
+		{
+			return;
+		}
+
+		double denseAccuracy = 0;
+		double denseMSE = 0;
+		GetSetAccuracyAndMSE(validationSet, denseAccuracy, denseMSE);
+		auto const [denseTime, denseBatchTime] = TimeInference(*m_pNetwork, validationSet);
+
+		double const achievedSparsity = m_pNetwork->prune(threshold, sparsity);
+		ClearFrozenFeatures();
+		if (m_verbosity >= 1)
+		{
+			std::cout << std::endl << "Pruned " << achievedSparsity * 100.0 << "% of the weights" << std::endl;
+		}
+
+		// Retrain with fresh optimizer state, pruned weights stay at 0
+		m_optimizer->initialize(m_pNetwork->m_weightsByLayer);
+		std::fill(m_rowLastStep.begin(), m_rowLastStep.end(), m_step);
+		for (uint64_t epoch = 0; epoch < retrainEpochs && !StopRequested(); ++epoch)
+		{
+			RunEpoch(trainingData.m_trainingSet);
+			++m_currentEpoch;
+			GetSetAccuracyAndMSE(trainingData.m_generalizationSet,
+				m_generalizationSetAccuracy,
+				m_generalizationSetMSE,
+				FrozenFeatures(trainingData.m_generalizationSet));
+			if (m_verbosity >= 1)
+			{
+				std::cout << "Retraining epoch: " << epoch
+					<< " Training Set Accuracy: " << m_trainingSetAccuracy
+					<< "%, MSE: " << m_trainingSetMSE
+					<< ". Generalization Set Accuracy:" << m_generalizationSetAccuracy
+					<< "%, MSE: " << m_generalizationSetMSE << std::endl;
+			}
+		}
+
+		m_pNetwork->compressPrunedLayers();
+		GetSetAccuracyAndMSE(validationSet, m_validationSetAccuracy, m_validationSetMSE);
+		auto const [sparseTime, sparseBatchTime] = TimeInference(*m_pNetwork, validationSet);
+
+		if (m_verbosity >= 1)
+		{
+			std::cout << std::endl
+				<< "==========================================================================" << std::endl
+				<< " Pruning report" << std::endl
+				<< " Sparsity: " << m_pNetwork->getSparsity() * 100.0 << "%" << std::endl
+				<< " Validation Set Accuracy: " << denseAccuracy << "% -> " << m_validationSetAccuracy
+				<< "% (delta: " << m_validationSetAccuracy - denseAccuracy << ")" << std::endl
+				<< " Single sample inference: " << denseTime * 1e6 << " us -> " << sparseTime * 1e6
+				<< " us (speedup: " << denseTime / sparseTime << "x)" << std::endl
+				<< " Batch inference: " << denseBatchTime * 1e6 << " us -> " << sparseBatchTime * 1e6
+				<< " us per sample (speedup: " << denseBatchTime / sparseBatchTime << "x)" << std::endl
+				<< "==========================================================================" << std::endl;
+		}
+	}
+
+	std::pair<double, double> NetworkTrainer::TimeInference(Network& network, TrainingSet const& trainingSet)
+	{
+		Matrix batchInputs((int)trainingSet.size(), network.m_numInputs);
+		Matrix batchOutputs((int)trainingSet.size(), network.m_numOutputs);
+		for (std::size_t b = 0; b < trainingSet.size(); ++b)
+		{
+			std::ranges::copy(trainingSet[b].m_inputs, batchInputs.data() + b * network.m_numInputs);
+		}
+
+		using Clock = std::chrono::steady_clock;
+		auto const start = Clock::now();
+		for (TrainingEntry const& entry : trainingSet)
+		{
+			network.Evaluate(entry.m_inputs);
+		}
+		auto const middle = Clock::now();
+		network.EvaluateBatch(batchInputs, batchOutputs);
+		auto const end = Clock::now();
+		return std::pair<double, double>(
+			std::chrono::duration<double>(middle - start).count() / trainingSet.size(),
+			std::chrono::duration<double>(end - middle).count() / trainingSet.size());
+	}
+
+	void NetworkTrainer::ReportDistillation(TrainingSet const& validationSet)
+	{
+		double numIncorrectResults = 0;
+		for (TrainingEntry const& entry : validationSet)
+		{
+			m_pTeacher->Evaluate(entry.m_inputs);
+			if (!m_loss->isCorrect(*m_pTeacher, entry.m_expectedOutputs))
+			{
+				numIncorrectResults++;
+			}
+		}
+		double const teacherAccuracy = 100.0 - (numIncorrectResults / validationSet.size() * 100.0);
+
+		auto numWeights = [](Network const& network)
+		{
+			std::size_t count = 0;
+			for (Matrix const& weights : network.m_weightsByLayer)
+			{
+				count += weights.size();
+			}
+			return count;
+		};
+		auto const [teacherTime, teacherBatchTime] = TimeInference(*m_pTeacher, validationSet);
+		auto const [studentTime, studentBatchTime] = TimeInference(*m_pNetwork, validationSet);
+
+		std::cout << "==========================================================================" << std::endl
+			<< " Distillation report (teacher -> student)" << std::endl
+			<< " Layers Sizes: " << m_pTeacher->m_layerSizes << " -> " << m_pNetwork->m_layerSizes << std::endl
+			<< std::setprecision(6) // changed by the layer sizes
+			<< " Weights: " << numWeights(*m_pTeacher) << " -> " << numWeights(*m_pNetwork) << std::endl
+			<< " Validation Set Accuracy: " << teacherAccuracy << "% -> " << m_validationSetAccuracy
+			<< "% (delta: " << m_validationSetAccuracy - teacherAccuracy << ")" << std::endl
+			<< " Single sample inference: " << teacherTime * 1e6 << " us -> " << studentTime * 1e6
+			<< " us (speedup: " << teacherTime / studentTime << "x)" << std::endl
+			<< " Batch inference: " << teacherBatchTime * 1e6 << " us -> " << studentBatchTime * 1e6
+			<< " us per sample (speedup: " << teacherBatchTime / studentBatchTime << "x)" << std::endl
+			<< "==========================================================================" << std::endl;
+	}
+
+	void NetworkTrainer::SaveBestWeights()
+	{
+		std::vector<Matrix> const& weightsByLayer = m_pNetwork->m_weightsByLayer;
+		if (m_bestWeights.empty())
+		{
+			m_bestWeights = std::vector<Matrix>(weightsByLayer);
+			std::size_t bytes = 0;
+			for (const Matrix& weights : m_bestWeights)
+			{
+				bytes += weights.byteSize();
+			}
+			m_bestWeightsMemory.update(bytes);
+			return;
+		}
+
+		for (std::size_t layer = 0; layer < weightsByLayer.size(); ++layer)
+		{
+			std::copy_n(weightsByLayer[layer].data(), weightsByLayer[layer].size(), m_bestWeights[layer].data());
+		}
 	}
 
-	double NetworkTrainer::getErrorGradient(int32_t layer, int32_t index) const
+	void NetworkTrainer::RestoreBestWeights()
 	{
-		assert(layer >= 1); // no error on input
-		assert(layer <= m_pNetwork->m_numLayers - 2); // output layer is computed differently
+		std::vector<Matrix>& weightsByLayer = m_pNetwork->m_weightsByLayer;
+		for (std::size_t layer = 0; layer < weightsByLayer.size(); ++layer)
+		{
+			std::copy_n(m_bestWeights[layer].data(), m_bestWeights[layer].size(), weightsByLayer[layer].data());
+		}
+	}
 
-		// Get sum of ``layer[i] --> layer[i+1] weights`` * layer[i+1] error dradients
-		double weightedSum = 0;
-		int32_t numOnNextLayer = m_pNetwork->m_layerSizes[layer + 1];
-		for (auto nextLayerIdx = 0; nextLayerIdx < numOnNextLayer; ++nextLayerIdx)
+	double NetworkTrainer::Benchmark(TrainingSet const& trainingSet, uint64_t epochs)
+	{
+		using Clock = std::chrono::steady_clock;
+		if (m_pCommunicator)
+		{
+			m_pCommunicator->barrier();
+		}
+		auto const start = Clock::now();
+		for (uint64_t epoch = 0; epoch < epochs; ++epoch)
 		{
-			weightedSum += m_pNetwork->m_weightsByLayer[layer](index, nextLayerIdx)
-				* m_errorGradients[layer + 1][nextLayerIdx];
+			m_optimizer->setLearningRate(m_schedule->learningRate(scheduleEpoch()));
+			RunEpoch(trainingSet);
+			++m_currentEpoch;
 		}
+		double const seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		double const numProcesses = m_pCommunicator ? m_pCommunicator->size() : 1;
+		return numProcesses * trainingSet.size() * epochs / seconds;
+	}
 
-		// Return error gradient
-		const Neuron& n = m_pNetwork->m_layers[layer][index];
-		double derivative = m_pNetwork->m_sigma->evalDerivative(n.activation, n.value);
-		return derivative * weightedSum;
+	bool NetworkTrainer::StopRequested() const
+	{
+		// Every process must leave the training loop at the same epoch
+		bool const stopRequested = StopWatcher::stopRequested();
+		return m_pCommunicator ? m_pCommunicator->sum(stopRequested ? 1.0 : 0.0) > 0.0 : stopRequested;
 	}
 
 	void NetworkTrainer::RunEpoch(TrainingSet const& trainingSet)
 	{
 		double incorrectEntries = 0;
 		double MSE = 0;
+		double sampledWeights = 0; // Importance sampling, sum of the weights of the drawn entries
 
-		for (auto const& trainingEntry : trainingSet)
+		// Batch learning : the weights are updated every m_miniBatchSize
+		// samples and at the end of the epoch
+		uint64_t samplesSinceUpdate = 0;
+		auto train = [&](TrainingEntry const& trainingEntry, const double* features, const double* targets,
+			double sampleWeight, double& squaredErrors)
 		{
-			// Feed inputs through network and back propagate errors
-			m_pNetwork->Evaluate(trainingEntry.m_inputs);
+			TrainOnEntry(trainingEntry, incorrectEntries, squaredErrors, features, targets, sampleWeight);
+			if (m_miniBatchSize > 0 && ++samplesSinceUpdate == m_miniBatchSize)
+			{
+				UpdateWeights();
+				samplesSinceUpdate = 0;
+			}
+		};
 
-			Backpropagate(trainingEntry.m_expectedOutputs);
+		if (m_pipelineStages > 1)
+		{
+			// Weights updated within the pipeline
+			RunPipelinedEpoch(trainingSet, incorrectEntries, MSE);
+		}
+		else if (m_augmentation)
+		{
+			// Distorted copies of the entries, prepared by the worker threads
+			m_augmentation->start(trainingSet, scheduleEpoch());
+			while (const TrainingEntry* trainingEntry = m_augmentation->next())
+			{
+				train(*trainingEntry, nullptr, nullptr, 1.0, MSE);
+			}
+		}
+		else
+		{
+			// Cached values of the last frozen layer, from which only the
+			// next layers are evaluated, and distillation targets
+			const Matrix* features = FrozenFeatures(trainingSet);
+			const Matrix* targets = DistillationTargets(trainingSet);
+			auto row = [](const Matrix* matrix, std::size_t entry) -> const double*
+			{
+				return matrix ? matrix->data() + entry * matrix->cols() : nullptr;
+			};
 
-			// Check all outputs from neural network against desired values
-			bool resultCorrect = true;
-			for (int outputIdx = 0; outputIdx < m_pNetwork->m_numOutputs; outputIdx++)
+			if (m_importanceSampling > 0.0)
 			{
-				if (m_pNetwork->m_clampedOutputs[outputIdx] != trainingEntry.m_expectedOutputs[outputIdx])
+				// The drawn entries only, each loss being updated by its pass.
+				// The statistics are weighted like the gradients, so that they
+				// estimate those of the whole training set.
+				SampleByImportance(trainingSet.size());
+				sampledWeights = 0.0;
+				for (std::size_t draw = 0; draw < m_sampledEntries.size(); ++draw)
 				{
-					resultCorrect = false;
+					uint32_t const entry = m_sampledEntries[draw];
+					double const weight = m_sampledWeights[draw];
+					double const incorrectBefore = incorrectEntries;
+					double squaredErrors = 0.0;
+					train(trainingSet[entry], row(features, entry), row(targets, entry), weight, squaredErrors);
+					m_sampleLosses[entry] = squaredErrors;
+					incorrectEntries = incorrectBefore + (incorrectEntries - incorrectBefore) * weight;
+					MSE += squaredErrors * weight;
+					sampledWeights += weight;
 				}
-
-				// Calculate MSE
-				MSE += pow(((*m_pNetwork->m_outputNeurons)[outputIdx].value
-					- trainingEntry.m_expectedOutputs[outputIdx]), 2);
 			}
-
-			if (!resultCorrect)
+			else
 			{
-				incorrectEntries++;
+				for (std::size_t entry = 0; entry < trainingSet.size(); ++entry)
+				{
+					train(trainingSet[entry], row(features, entry), row(targets, entry), 1.0, MSE);
+				}
 			}
 		}
 
 		// If using batch learning - update the weights
 		if (m_useBatchLearning)
 		{
-			UpdateWeights();
+			if (m_pipelineStages == 1 && (m_miniBatchSize == 0 || samplesSinceUpdate > 0))
+			{
+				UpdateWeights();
+			}
+		}
+		else
+		{
+			FlushLazyUpdates(m_step);
 		}
 
-		// Update training accuracy and MSE
-		m_trainingSetAccuracy = 100.0 - (incorrectEntries / trainingSet.size() * 100.0);
-		m_trainingSetMSE = MSE / (m_pNetwork->m_numOutputs * trainingSet.size());
+		// Update training accuracy and MSE, over the shards of all the processes
+		// (over the weighted drawn entries with importance sampling)
+		double numEntries = m_importanceSampling > 0.0 ? sampledWeights : static_cast<double>(trainingSet.size());
+		if (m_pCommunicator)
+		{
+			std::span<double> statistics = m_pCommunicator->buffer();
+			statistics[0] = incorrectEntries;
+			statistics[1] = MSE;
+			statistics[2] = numEntries;
+			m_pCommunicator->allReduceSum(3);
+			incorrectEntries = statistics[0];
+			MSE = statistics[1];
+			numEntries = statistics[2];
+		}
+		m_trainingSetAccuracy = 100.0 - (incorrectEntries / numEntries * 100.0);
+		m_trainingSetMSE = MSE / (m_pNetwork->m_numOutputs * numEntries);
 
 		if (m_verbosity >= 3)
 		{
@@ -197,131 +706,988 @@ namespace bpn
 		}
 	}
 
-	void NetworkTrainer::Backpropagate(std::vector<int32_t> const& expectedOutputs)
+	void NetworkTrainer::TrainOnEntry(TrainingEntry const& trainingEntry, double& incorrectEntries, double& MSE,
+		const double* features, const double* targets, double sampleWeight)
 	{
-		// Modify deltas between the last hidden layer and output layers
-		//---------------------------------------------------------------------
-		int32_t numLayers = m_pNetwork->m_numLayers;
-		bpn::Network::Layer& lastHiddenNeurons = *m_pNetwork->m_lastHiddenNeurons;
-		bpn::Network::Layer& outputNeurons = *m_pNetwork->m_outputNeurons;
-
-		for (auto outputIdx = 0; outputIdx < m_pNetwork->m_numOutputs; ++outputIdx)
+		// Feed inputs through network and back propagate errors
+		if (features)
 		{
-			// Get error gradient for every output node
-			m_errorGradients[numLayers - 1][outputIdx] = getOutputErrorGradient(
-				(double)expectedOutputs[outputIdx],
-				outputNeurons[outputIdx]);
-
-			// For all nodes in the last hidden layer and bias neuron
-			for (auto hiddenIdx = 0; hiddenIdx <= m_pNetwork->m_numOnLastHidden; ++hiddenIdx)
+			m_pNetwork->EvaluateFrom(m_frozenLayers, { features, static_cast<std::size_t>(m_pNetwork->m_layerSizes[m_frozenLayers]) });
+		}
+		else
+		{
+			m_pNetwork->SetInput(trainingEntry.m_inputs);
+			if (!m_useBatchLearning)
 			{
-				// Calculate change in weight
-				if (m_useBatchLearning)
-				{
-					m_deltas[numLayers - 2](hiddenIdx, outputIdx) +=
-						m_learningRate
-						* lastHiddenNeurons[hiddenIdx].value
-						* m_errorGradients[numLayers - 1][outputIdx];
-				}
-				else
-				{
-					m_deltas[numLayers - 2](hiddenIdx, outputIdx) =
-						m_learningRate
-						* lastHiddenNeurons[hiddenIdx].value
-						* m_errorGradients[numLayers - 1][outputIdx]
-						+ m_momentum * m_deltas[numLayers - 2](hiddenIdx, outputIdx);
-				}
+				CatchUpFirstLayer();
 			}
+			m_pNetwork->EvaluateLayers(0, m_pNetwork->m_numLayers - 1);
 		}
 
-		//// Modify deltas between all other layers
-		////--------------------------------------------------------------------
-		// deltas[numLaters-2] have been computed, lets compute all others.
-		for (int32_t layer = numLayers - 3; layer >= 0; --layer)
+		if (m_useBatchLearning)
 		{
-			// ``next layer`` is (layer+1)-th layer
-			// ``actual layer`` is layer-th layer
-			for (auto nextIdx = 0; nextIdx < m_pNetwork->m_layerSizes[layer + 1]; nextIdx++)
-			{
-				// Get error gradient for every hidden node
-				m_errorGradients[layer + 1][nextIdx] = getErrorGradient(layer + 1, nextIdx);
+			Backpropagate(trainingEntry.m_expectedOutputs, targets, sampleWeight);
+		}
+		else
+		{
+			BackpropagateAndUpdate(trainingEntry.m_expectedOutputs, targets, sampleWeight);
+		}
 
-				// For all nodes in actual layer and bias neuron
-				for (auto actualIdx = 0; actualIdx <= m_pNetwork->m_layerSizes[layer]; actualIdx++)
-				{
-					// Calculate change in weight 
-					if (m_useBatchLearning)
-					{
-						m_deltas[layer](actualIdx, nextIdx) +=
-							m_learningRate
-							* m_pNetwork->m_layers[layer][actualIdx].value
-							* m_errorGradients[layer + 1][nextIdx];
-					}
-					else
-					{
-						m_deltas[layer](actualIdx, nextIdx) =
-							m_learningRate
-							* m_pNetwork->m_layers[layer][actualIdx].value
-							* m_errorGradients[layer + 1][nextIdx]
-							+ m_momentum * m_deltas[layer](actualIdx, nextIdx);
-					}
-				}
-			}
+		// Check outputs from neural network against desired values
+		bool resultCorrect = m_loss->isCorrect(*m_pNetwork, trainingEntry.m_expectedOutputs);
+		AddSquaredErrors(trainingEntry.m_expectedOutputs, MSE);
 
+		if (!resultCorrect)
+		{
+			incorrectEntries++;
 		}
+	}
 
-		// If using stochastic learning update the weights immediately
-		if (!m_useBatchLearning)
+	void NetworkTrainer::OutputErrorGradients(std::vector<int32_t> const& expectedOutputs, const double* targets,
+		double sampleWeight)
+	{
+		double* outputErrorGradients = m_pNetwork->errorGradients(m_pNetwork->m_numLayers - 1);
+		if (targets)
 		{
-			UpdateWeights();
+			m_loss->outputErrorGradients(*m_pNetwork, { targets, static_cast<std::size_t>(m_pNetwork->m_numOutputs) },
+				outputErrorGradients);
+		}
+		else
+		{
+			m_loss->outputErrorGradients(*m_pNetwork, expectedOutputs, outputErrorGradients);
+		}
+		if (sampleWeight != 1.0)
+		{
+			// Every error gradient of the entry is linear in these
+			for (int32_t outputIdx = 0; outputIdx < m_pNetwork->m_numOutputs; ++outputIdx)
+			{
+				outputErrorGradients[outputIdx] *= sampleWeight;
+			}
 		}
-
 	}
 
-	void NetworkTrainer::UpdateWeights()
+	void NetworkTrainer::SampleByImportance(std::size_t numEntries)
 	{
-		for (int32_t layer = 0; layer < m_pNetwork->m_numLayers - 1; ++layer)
+		m_sampledEntries.clear();
+		m_sampledWeights.clear();
+		if (m_sampleLosses.size() != numEntries)
 		{
-			for (int32_t actualIdx = 0; actualIdx <= m_pNetwork->m_layerSizes[layer]; ++actualIdx)
+			// First epoch : every loss is measured
+			m_sampleLosses.assign(numEntries, 0.0);
+			for (std::size_t entry = 0; entry < numEntries; ++entry)
 			{
-				for (int32_t nextIdx = 0; nextIdx < m_pNetwork->m_layerSizes[layer + 1]; ++nextIdx)
-				{
-					m_pNetwork->m_weightsByLayer[layer](actualIdx, nextIdx) +=
-						m_deltas[layer](actualIdx, nextIdx);
-
-					// Clear delta only if using batch (previous delta is needed for momentum
-					if (m_useBatchLearning)
-					{
-						m_deltas[layer](actualIdx, nextIdx) = 0.0;
-					}
-
-				}
+				m_sampledEntries.push_back(static_cast<uint32_t>(entry));
 			}
+			m_sampledWeights.assign(numEntries, 1.0);
+			return;
+		}
+
+		double totalLoss = 0.0;
+		for (double loss : m_sampleLosses)
+		{
+			totalLoss += loss;
+		}
+		double const uniform = totalLoss > 0.0 ? ImportanceUniformShare / numEntries : 1.0 / numEntries;
+		double const lossShare = totalLoss > 0.0 ? (1.0 - ImportanceUniformShare) / totalLoss : 0.0;
+		auto probability = [&](std::size_t entry)
+		{
+			return uniform + lossShare * m_sampleLosses[entry];
+		};
 
+		std::discrete_distribution<std::size_t> distribution(numEntries, 0.0, static_cast<double>(numEntries),
+			[&](double x) { return probability(static_cast<std::size_t>(x)); });
+		std::size_t const numDraws = std::max<std::size_t>(1, static_cast<std::size_t>(std::lround(m_importanceSampling * numEntries)));
+		for (std::size_t draw = 0; draw < numDraws; ++draw)
+		{
+			std::size_t const entry = distribution(m_importanceGenerator);
+			m_sampledEntries.push_back(static_cast<uint32_t>(entry));
+			m_sampledWeights.push_back(1.0 / (numEntries * probability(entry)));
 		}
 	}
 
-	void NetworkTrainer::GetSetAccuracyAndMSE(TrainingSet const& trainingSet, double& accuracy, double& MSE) const
+	void NetworkTrainer::Backpropagate(std::vector<int32_t> const& expectedOutputs, const double* targets, double sampleWeight)
 	{
-		accuracy = 0;
-		MSE = 0;
+		int32_t numLayers = m_pNetwork->m_numLayers;
 
-		double numIncorrectResults = 0;
-		for (auto const& trainingEntry : trainingSet)
-		{
-			m_pNetwork->Evaluate(trainingEntry.m_inputs);
+		// Get error gradient for every output node
+		OutputErrorGradients(expectedOutputs, targets, sampleWeight);
 
-			// Check if the network outputs match the expected outputs
-			bool correctResult = true;
-			for (int32_t outputIdx = 0; outputIdx < m_pNetwork->m_numOutputs; outputIdx++)
-			{
-				if ((double)m_pNetwork->m_clampedOutputs[outputIdx] != trainingEntry.m_expectedOutputs[outputIdx])
-				{
-					correctResult = false;
-				}
+		// Weight error gradients from ``layer`` to ``layer + 1``, summed in one
+		// contiguous row of deltas per neuron of ``layer``
+		auto computeDeltaRow = [&](int32_t layer, int32_t actualIdx)
+		{
+			int32_t const numNext = m_pNetwork->m_layerSizes[layer + 1];
+			double const value = m_pNetwork->values(layer)[actualIdx];
+			AccumulateDeltas(value, m_pNetwork->errorGradients(layer + 1), m_deltas[layer].data() + actualIdx * numNext, numNext);
+		};
 
-				MSE += pow(((*m_pNetwork->m_outputNeurons)[outputIdx].value - trainingEntry.m_expectedOutputs[outputIdx]), 2);
+		// Modify deltas between the last hidden layer and output layers
+		//---------------------------------------------------------------------
+		// For all nodes in the last hidden layer and bias neuron
+		for (auto hiddenIdx = 0; hiddenIdx <= m_pNetwork->m_numOnLastHidden; ++hiddenIdx)
+		{
+			computeDeltaRow(numLayers - 2, hiddenIdx);
+		}
+
+		//// Modify deltas between all other layers
+		////--------------------------------------------------------------------
+		// deltas[numLaters-2] have been computed, lets compute all others
+		// down to the last frozen layer.
+		for (int32_t layer = numLayers - 3; layer >= m_frozenLayers; --layer)
+		{
+			// ``next layer`` is (layer+1)-th layer
+			// ``actual layer`` is layer-th layer
+			// Error gradients of the next layer : W * (error gradients of the
+			// layer after), bias row excluded, times the derivatives
+			int32_t const next = layer + 1;
+			int32_t const numNext = m_pNetwork->m_layerSizes[next];
+			double* nextErrorGradients = m_pNetwork->errorGradients(next);
+			kernels::multiply(m_pNetwork->m_weightsByLayer[next].data(), m_pNetwork->errorGradients(next + 1),
+				nextErrorGradients, numNext, m_pNetwork->m_layerSizes[next + 1]);
+			m_pNetwork->activationFunction(next).multiplyDerivative(m_pNetwork->activations(next),
+				m_pNetwork->values(next), nextErrorGradients, numNext);
+
+			if (layer == 0 && useSparseFirstLayer())
+			{
+				BackpropagateSparseFirstLayer();
+				continue;
+			}
+
+			// For all nodes in actual layer and bias neuron
+			for (auto actualIdx = 0; actualIdx <= m_pNetwork->m_layerSizes[layer]; actualIdx++)
+			{
+				computeDeltaRow(layer, actualIdx);
+			}
+		}
+	}
+
+	void NetworkTrainer::BackpropagateAndUpdate(std::vector<int32_t> const& expectedOutputs, const double* targets,
+		double sampleWeight)
+	{
+		int32_t const numLayers = m_pNetwork->m_numLayers;
+		OutputErrorGradients(expectedOutputs, targets, sampleWeight);
+
+		m_optimizer->beginStep();
+		++m_step;
+		bool const pruned = m_pNetwork->isPruned();
+
+		// From the last layer of weights to the first one. The error gradients
+		// of ``layer`` only depend on the weights of ``layer``, so they are
+		// computed from each row just before the update of this row. Frozen
+		// layers are left as they are. Only the updated rows are masked again.
+		for (int32_t layer = numLayers - 2; layer >= m_frozenLayers; --layer)
+		{
+			Matrix& weights = m_pNetwork->m_weightsByLayer[layer];
+			int32_t const numActual = m_pNetwork->m_layerSizes[layer];
+			int32_t const numNext = m_pNetwork->m_layerSizes[layer + 1];
+			const double* values = m_pNetwork->values(layer);
+			const double* activations = m_pNetwork->activations(layer);
+			const double* __restrict nextErrorGradients = m_pNetwork->errorGradients(layer + 1);
+
+			if (layer == 0)
+			{
+				// Input layer has no error gradient. Rows of the zero inputs
+				// have a null gradient : their update is postponed until they
+				// are active again, or until the next flush. The rows updated
+				// here were caught up before the forward pass.
+				auto updateRow = [&](int32_t row)
+				{
+					m_optimizer->updateRow(0, weights, row, values[row], nextErrorGradients);
+					m_rowLastStep[row] = m_step;
+					if (pruned)
+					{
+						m_pNetwork->applyPruningMask(0, row, row + 1);
+					}
+				};
+				if (useSparseFirstLayer())
+				{
+					for (int32_t row : m_pNetwork->m_activeInputs)
+					{
+						updateRow(row);
+					}
+				}
+				else
+				{
+					for (int32_t row = 0; row < numActual; ++row)
+					{
+						updateRow(row);
+					}
+				}
+				updateRow(numActual);
+				continue;
+			}
+
+			if (layer == m_frozenLayers)
+			{
+				// The error gradients of the last frozen layer are not needed
+				for (int32_t actualIdx = 0; actualIdx < numActual; ++actualIdx)
+				{
+					m_optimizer->updateRow(layer, weights, actualIdx, values[actualIdx], nextErrorGradients);
+				}
+				m_optimizer->updateRow(layer, weights, numActual, values[numActual], nextErrorGradients);
+				if (pruned)
+				{
+					m_pNetwork->applyPruningMask(layer, 0, numActual + 1);
+				}
+				continue;
+			}
+
+			// Rows of W * (error gradients of the next layer), then derivatives
+			double* actualErrorGradients = m_pNetwork->errorGradients(layer);
+			for (int32_t actualIdx = 0; actualIdx < numActual; ++actualIdx)
+			{
+				actualErrorGradients[actualIdx] = kernels::dot(weights.data() + actualIdx * numNext, nextErrorGradients, numNext);
+				m_optimizer->updateRow(layer, weights, actualIdx, values[actualIdx], nextErrorGradients);
+			}
+			m_pNetwork->activationFunction(layer).multiplyDerivative(activations, values, actualErrorGradients, numActual);
+
+			// Bias neuron
+			m_optimizer->updateRow(layer, weights, numActual, values[numActual], nextErrorGradients);
+			if (pruned)
+			{
+				m_pNetwork->applyPruningMask(layer, 0, numActual + 1);
+			}
+		}
+	}
+
+	void NetworkTrainer::BackpropagateSparseFirstLayer()
+	{
+		// Only the rows of the non-zero inputs and of the bias have a non-zero
+		// weight error gradient
+		int32_t const numHidden = m_pNetwork->m_layerSizes[1];
+		const double* inputValues = m_pNetwork->values(0);
+		const double* errorGradients = m_pNetwork->errorGradients(1);
+		Matrix& deltas = m_deltas[0];
+		auto computeRow = [&](int32_t actualIdx)
+		{
+			AccumulateDeltas(inputValues[actualIdx], errorGradients, deltas.data() + actualIdx * numHidden, numHidden);
+		};
+		for (int32_t actualIdx : m_pNetwork->m_activeInputs)
+		{
+			computeRow(actualIdx);
+		}
+		computeRow(m_pNetwork->m_numInputs);
+	}
+
+	void NetworkTrainer::UpdateWeights()
+	{
+		if (m_pCommunicator)
+		{
+			// Sum of the error gradients of every process, so that all the
+			// processes apply the same update to the same weights. The deltas
+			// of the frozen layers stay at 0.
+			std::span<double> buffer = m_pCommunicator->buffer();
+			std::size_t offset = 0;
+			for (const Matrix& deltas : m_deltas | std::views::drop(m_frozenLayers))
+			{
+				std::copy_n(deltas.data(), deltas.size(), buffer.data() + offset);
+				offset += deltas.size();
+			}
+			m_pCommunicator->allReduceSum(offset);
+			offset = 0;
+			for (Matrix& deltas : m_deltas | std::views::drop(m_frozenLayers))
+			{
+				std::copy_n(buffer.data() + offset, deltas.size(), deltas.data());
+				offset += deltas.size();
+			}
+		}
+
+		m_optimizer->beginStep();
+		++m_step;
+		for (int32_t layer = m_frozenLayers; layer < m_pNetwork->m_numLayers - 1; ++layer)
+		{
+			m_optimizer->update(layer, m_pNetwork->m_weightsByLayer[layer], m_deltas[layer]);
+
+			// Batch learning accumulates error gradients over the whole epoch
+			m_deltas[layer].fill(0.0);
+		}
+
+		if (m_pNetwork->isPruned())
+		{
+			m_pNetwork->applyPruningMasks();
+		}
+	}
+
+	void NetworkTrainer::CatchUpFirstLayer()
+	{
+		if (m_frozenLayers > 0)
+		{
+			return;
+		}
+		if (!useSparseFirstLayer())
+		{
+			// Every row is updated by this sample
+			FlushLazyUpdates(m_step);
+			return;
+		}
+
+		Matrix& weights = m_pNetwork->m_weightsByLayer[0];
+		std::size_t const numCols = weights.cols();
+		auto catchUpRow = [&](int32_t row)
+		{
+			if (m_rowLastStep[row] < m_step)
+			{
+				m_optimizer->skipSteps(0, weights, row * numCols, (row + 1) * numCols, m_step - m_rowLastStep[row]);
+				m_rowLastStep[row] = m_step;
+				if (m_pNetwork->isPruned())
+				{
+					m_pNetwork->applyPruningMask(0, row, row + 1);
+				}
 			}
+		};
+		for (int32_t row : m_pNetwork->m_activeInputs)
+		{
+			catchUpRow(row);
+		}
+		catchUpRow(m_pNetwork->m_numInputs);
+	}
+
+	void NetworkTrainer::FlushLazyUpdates(uint64_t step)
+	{
+		if (!m_optimizer->supportsLazyUpdates() || m_frozenLayers > 0)
+		{
+			return;
+		}
+
+		Matrix& weights = m_pNetwork->m_weightsByLayer[0];
+		std::size_t const numCols = weights.cols();
+		for (std::size_t row = 0; row < m_rowLastStep.size(); ++row)
+		{
+			if (m_rowLastStep[row] < step)
+			{
+				m_optimizer->skipSteps(0, weights, row * numCols, (row + 1) * numCols, step - m_rowLastStep[row]);
+				m_rowLastStep[row] = step;
+				if (m_pNetwork->isPruned())
+				{
+					m_pNetwork->applyPruningMask(0, row, row + 1);
+				}
+			}
+		}
+	}
+
+	//-------------------------------------------------------------------------
+	// Pipeline parallel training
+	//-------------------------------------------------------------------------
+
+	// Forward state of a micro-batch on a stage, kept for its backward pass
+	struct NetworkTrainer::PipelineStash
+	{
+		int32_t             count = 0;               // samples in the micro-batch
+		bool                lastOfMiniBatch = false; // the stage updates its layers after its backward pass
+		// values[k] : micro-batch x size of the k-th neuron layer of the stage,
+		// values[0] being the input of the stage. activations[k] goes with
+		// values[k + 1].
+		std::vector<Matrix> values;
+		std::vector<Matrix> activations;
+	};
+
+	// Micro-batch handed by a stage to the next one
+	struct NetworkTrainer::PipelineMessage
+	{
+		int32_t             count = 0;
+		bool                lastOfMiniBatch = false;
+		Matrix              values;                  // micro-batch x size of the layer between the stages
+		std::vector<std::vector<int32_t>> expectedOutputs;
+	};
+
+	struct NetworkTrainer::PipelineStage
+	{
+		int32_t             firstLayer;    // weights [firstLayer, endLayer) of m_weightsByLayer
+		int32_t             endLayer;
+		std::size_t         maxInFlight;   // micro-batches forwarded but not back-propagated yet
+		std::deque<std::unique_ptr<PipelineStash>>  inFlight;
+		std::vector<std::unique_ptr<PipelineStash>> spare;
+		// errorGradients[k] : error gradients of one sample for neuron layer
+		// firstLayer + 1 + k
+		std::vector<std::vector<double>> errorGradients;
+		std::unique_ptr<SpscQueue<PipelineMessage>> input;     // from the previous stage, null on the first one
+		std::unique_ptr<SpscQueue<Matrix>>          gradients; // from the next stage, null on the last one
+		std::optional<Matrix> outputErrorGradients;           // last stage, given by the loss function
+		Doorbell            doorbell;      // rung by a push in ``input`` or ``gradients``
+
+		// Training statistics of the epoch, last stage only
+		double              incorrectEntries = 0;
+		double              MSE = 0;
+
+		std::unique_ptr<PipelineStash> takeStash()
+		{
+			std::unique_ptr<PipelineStash> stash = std::move(spare.back());
+			spare.pop_back();
+			return stash;
+		}
+	};
+
+	struct NetworkTrainer::Pipeline
+	{
+		std::vector<std::unique_ptr<PipelineStage>> stages;
+		std::vector<std::thread> threads;                // stages 1 and above
+		std::size_t              microBatchesPerMiniBatch;
+		std::atomic<bool>        stopping{ false };
+		std::atomic<bool>        failed{ false };
+		std::mutex               errorMutex;
+		std::exception_ptr       error;                  // first failure of a stage thread
+		MemoryTracker::Registration memory{ MemoryTracker::Category::trainer };
+	};
+
+	std::vector<int32_t> NetworkTrainer::partitionLayers(const std::vector<int>& layerSizes, int32_t numStages)
+	{
+		// cumulativeWeights[l] : weights of the layers of weights before l
+		int32_t const numWeightLayers = static_cast<int32_t>(layerSizes.size()) - 1;
+		assert(numStages >= 1 && numStages <= numWeightLayers);
+		std::vector<double> cumulativeWeights(numWeightLayers + 1, 0.0);
+		for (int32_t layer = 0; layer < numWeightLayers; ++layer)
+		{
+			cumulativeWeights[layer + 1] = cumulativeWeights[layer] + (layerSizes[layer] + 1.0) * layerSizes[layer + 1];
+		}
+
+		// Each boundary is the closest to its share of the weights, leaving at
+		// least one layer to every stage
+		std::vector<int32_t> firstLayers{ 0 };
+		for (int32_t stage = 1; stage < numStages; ++stage)
+		{
+			double const target = cumulativeWeights.back() * stage / numStages;
+			int32_t layer = firstLayers.back() + 1;
+			while (layer < numWeightLayers - (numStages - stage)
+				&& std::abs(cumulativeWeights[layer + 1] - target) < std::abs(cumulativeWeights[layer] - target))
+			{
+				++layer;
+			}
+			firstLayers.push_back(layer);
+		}
+		firstLayers.push_back(numWeightLayers);
+		return firstLayers;
+	}
+
+	void NetworkTrainer::StartPipeline(std::size_t numSamples)
+	{
+		// Micro-batches of a mini-batch, all in flight at once with GPipe
+		std::size_t const miniBatchSize = m_miniBatchSize > 0 ? std::min<std::size_t>(m_miniBatchSize, numSamples) : numSamples;
+		std::size_t const microBatchesPerMiniBatch = std::max<std::size_t>(1,
+			(miniBatchSize + m_pipelineMicroBatch - 1) / m_pipelineMicroBatch);
+		if (m_pipeline && (!m_pipelineGPipe || m_pipeline->microBatchesPerMiniBatch >= microBatchesPerMiniBatch))
+		{
+			return;
+		}
+		StopPipeline();
+
+		std::vector<int> const& layerSizes = m_pNetwork->m_layerSizes;
+		std::vector<int32_t> const firstLayers = partitionLayers(layerSizes, m_pipelineStages);
+		m_pipeline = std::make_unique<Pipeline>();
+		m_pipeline->microBatchesPerMiniBatch = microBatchesPerMiniBatch;
+
+		std::size_t bytes = 0;
+		for (int32_t index = 0; index < m_pipelineStages; ++index)
+		{
+			auto stage = std::make_unique<PipelineStage>();
+			stage->firstLayer = firstLayers[index];
+			stage->endLayer = firstLayers[index + 1];
+			bool const lastStage = index + 1 == m_pipelineStages;
+
+			// 1F1B : a stage holds at most one micro-batch per following stage,
+			// the last one back-propagates each micro-batch right away
+			stage->maxInFlight = lastStage ? 1
+				: m_pipelineGPipe ? microBatchesPerMiniBatch
+				: std::min<std::size_t>(m_pipelineStages - index, microBatchesPerMiniBatch);
+
+			for (std::size_t k = 0; k < stage->maxInFlight; ++k)
+			{
+				auto stash = std::make_unique<PipelineStash>();
+				stash->values.emplace_back(m_pipelineMicroBatch, layerSizes[stage->firstLayer]);
+				for (int32_t layer = stage->firstLayer + 1; layer <= stage->endLayer; ++layer)
+				{
+					stash->values.emplace_back(m_pipelineMicroBatch, layerSizes[layer]);
+					stash->activations.emplace_back(m_pipelineMicroBatch, layerSizes[layer]);
+					bytes += 2 * stash->values.back().byteSize();
+				}
+				bytes += stash->values.front().byteSize();
+				stage->spare.push_back(std::move(stash));
+			}
+			for (int32_t layer = stage->firstLayer + 1; layer <= stage->endLayer; ++layer)
+			{
+				stage->errorGradients.emplace_back(layerSizes[layer]);
+			}
+			if (lastStage)
+			{
+				stage->outputErrorGradients.emplace(m_pipelineMicroBatch, m_pNetwork->m_numOutputs);
+			}
+
+			// Capacities such that a push never waits : every message belongs
+			// to a micro-batch in flight on the previous stage
+			if (index > 0)
+			{
+				PipelineStage& previous = *m_pipeline->stages.back();
+				PipelineMessage prototype{ 0, false, Matrix(m_pipelineMicroBatch, layerSizes[stage->firstLayer]),
+					std::vector<std::vector<int32_t>>(m_pipelineMicroBatch, std::vector<int32_t>(m_pNetwork->m_numOutputs)) };
+				stage->input = std::make_unique<SpscQueue<PipelineMessage>>(previous.maxInFlight, prototype);
+				previous.gradients = std::make_unique<SpscQueue<Matrix>>(previous.maxInFlight, prototype.values);
+				bytes += 2 * previous.maxInFlight * prototype.values.byteSize();
+			}
+			m_pipeline->stages.push_back(std::move(stage));
+		}
+		m_pipeline->memory.update(bytes);
+
+		for (int32_t index = 1; index < m_pipelineStages; ++index)
+		{
+			m_pipeline->threads.emplace_back(&NetworkTrainer::RunPipelineStage, this, index);
+		}
+	}
+
+	void NetworkTrainer::StopPipeline()
+	{
+		if (!m_pipeline)
+		{
+			return;
+		}
+		m_pipeline->stopping.store(true);
+		for (std::unique_ptr<PipelineStage>& stage : m_pipeline->stages)
+		{
+			stage->doorbell.ring();
+		}
+		for (std::thread& thread : m_pipeline->threads)
+		{
+			thread.join();
+		}
+		m_pipeline.reset();
+	}
+
+	void NetworkTrainer::CheckPipeline() const
+	{
+		if (m_pipeline->failed.load())
+		{
+			std::lock_guard<std::mutex> lock(m_pipeline->errorMutex);
+			std::rethrow_exception(m_pipeline->error);
+		}
+	}
+
+	void NetworkTrainer::RunPipelinedEpoch(TrainingSet const& trainingSet, double& incorrectEntries, double& MSE)
+	{
+		StartPipeline(trainingSet.size());
+		PipelineStage& first = *m_pipeline->stages.front();
+		PipelineStage& second = *m_pipeline->stages[1];
+		PipelineStage& last = *m_pipeline->stages.back();
+		int32_t const numInputs = m_pNetwork->m_numInputs;
+
+		// Entries of the epoch, distorted copies when augmenting
+		std::size_t position = 0;
+		if (m_augmentation)
+		{
+			m_augmentation->start(trainingSet, scheduleEpoch());
+		}
+		auto nextEntry = [&]() -> const TrainingEntry*
+		{
+			if (m_augmentation)
+			{
+				return m_augmentation->next();
+			}
+			return position < trainingSet.size() ? &trainingSet[position++] : nullptr;
+		};
+
+		// Stage 0 runs here, one mini-batch at a time
+		const TrainingEntry* entry = nextEntry();
+		while (entry != nullptr)
+		{
+			// Every stage updates its layers within this step
+			m_optimizer->beginStep();
+			++m_step;
+
+			uint64_t remaining = m_miniBatchSize > 0 ? m_miniBatchSize : std::numeric_limits<uint64_t>::max();
+			bool moreMicroBatches = true;
+			while (moreMicroBatches || !first.inFlight.empty())
+			{
+				uint32_t const seen = first.doorbell.value();
+				CheckPipeline();
+				bool const canForward = moreMicroBatches && first.inFlight.size() < first.maxInFlight;
+				bool const canBackward = !first.gradients->empty();
+				if (canForward && (m_pipelineGPipe || !canBackward))
+				{
+					// Next micro-batch of the mini-batch. An augmented entry is
+					// only valid until the next one, it is copied right away.
+					std::unique_ptr<PipelineStash> stash = first.takeStash();
+					PipelineMessage& message = second.input->back();
+					int32_t count = 0;
+					for (; count < m_pipelineMicroBatch && remaining > 0 && entry != nullptr; ++count, --remaining)
+					{
+						std::copy_n(entry->m_inputs.data(), numInputs, stash->values.front().data() + count * numInputs);
+						std::ranges::copy(entry->m_expectedOutputs, message.expectedOutputs[count].begin());
+						entry = nextEntry();
+					}
+					moreMicroBatches = remaining > 0 && entry != nullptr;
+					stash->count = count;
+					stash->lastOfMiniBatch = !moreMicroBatches;
+
+					PipelineForward(0, *stash);
+					PipelineSend(0, *stash);
+					first.inFlight.push_back(std::move(stash));
+				}
+				else if (canBackward)
+				{
+					std::unique_ptr<PipelineStash> stash = std::move(first.inFlight.front());
+					first.inFlight.pop_front();
+					PipelineBackward(0, *stash, first.gradients->front(), false, nullptr);
+					first.gradients->pop();
+					if (stash->lastOfMiniBatch)
+					{
+						PipelineUpdate(0);
+					}
+					first.spare.push_back(std::move(stash));
+				}
+				else
+				{
+					first.doorbell.wait(seen);
+				}
+			}
+
+			// The other stages are idle until the next micro-batch
+			if (m_pNetwork->isPruned())
+			{
+				m_pNetwork->applyPruningMasks();
+			}
+		}
+
+		incorrectEntries = last.incorrectEntries;
+		MSE = last.MSE;
+		last.incorrectEntries = 0;
+		last.MSE = 0;
+	}
+
+	void NetworkTrainer::RunPipelineStage(int32_t index)
+	{
+		PipelineStage& stage = *m_pipeline->stages[index];
+		PipelineStage& previous = *m_pipeline->stages[index - 1];
+		bool const lastStage = index + 1 == m_pipelineStages;
+		int32_t const numOutputs = m_pNetwork->m_numOutputs;
+		int32_t const outputLayer = m_pNetwork->m_numLayers - 1;
+
+		try
+		{
+			for (;;)
+			{
+				uint32_t const seen = stage.doorbell.value();
+				if (m_pipeline->stopping.load() || m_pipeline->failed.load())
+				{
+					return;
+				}
+				bool const canForward = !stage.input->empty() && stage.inFlight.size() < stage.maxInFlight;
+				bool const canBackward = !lastStage && !stage.gradients->empty();
+				if (canForward && (m_pipelineGPipe || !canBackward))
+				{
+					PipelineMessage& message = stage.input->front();
+					std::unique_ptr<PipelineStash> stash = stage.takeStash();
+					stash->count = message.count;
+					stash->lastOfMiniBatch = message.lastOfMiniBatch;
+					std::copy_n(message.values.data(), message.count * message.values.cols(), stash->values.front().data());
+					PipelineForward(index, *stash);
+
+					if (!lastStage)
+					{
+						PipelineMessage& next = m_pipeline->stages[index + 1]->input->back();
+						for (int32_t sample = 0; sample < message.count; ++sample)
+						{
+							std::ranges::copy(message.expectedOutputs[sample], next.expectedOutputs[sample].begin());
+						}
+						stage.input->pop();
+						PipelineSend(index, *stash);
+						stage.inFlight.push_back(std::move(stash));
+						continue;
+					}
+
+					// Output layer : loss and training statistics of every
+					// sample, as TrainOnEntry, then back-propagation right away
+					Matrix& outputErrorGradients = *stage.outputErrorGradients;
+					for (int32_t sample = 0; sample < stash->count; ++sample)
+					{
+						std::vector<int32_t> const& expectedOutputs = message.expectedOutputs[sample];
+						std::copy_n(stash->activations.back().data() + sample * numOutputs, numOutputs,
+							m_pNetwork->activations(outputLayer));
+						std::copy_n(stash->values.back().data() + sample * numOutputs, numOutputs,
+							m_pNetwork->values(outputLayer));
+						m_pNetwork->UpdateClampedOutputs();
+						m_loss->outputErrorGradients(*m_pNetwork, expectedOutputs,
+							outputErrorGradients.data() + sample * numOutputs);
+						AddSquaredErrors(expectedOutputs, stage.MSE);
+						if (!m_loss->isCorrect(*m_pNetwork, expectedOutputs))
+						{
+							stage.incorrectEntries++;
+						}
+					}
+					stage.input->pop();
+					PipelineBackward(index, *stash, outputErrorGradients, true, &previous.gradients->back());
+					if (stash->lastOfMiniBatch)
+					{
+						PipelineUpdate(index);
+					}
+					previous.gradients->push();
+					previous.doorbell.ring();
+					stage.spare.push_back(std::move(stash));
+				}
+				else if (canBackward)
+				{
+					std::unique_ptr<PipelineStash> stash = std::move(stage.inFlight.front());
+					stage.inFlight.pop_front();
+					PipelineBackward(index, *stash, stage.gradients->front(), false, &previous.gradients->back());
+					stage.gradients->pop();
+
+					// Before handing the gradients over : once the first stage
+					// has them all, the mini-batch is over on every stage
+					if (stash->lastOfMiniBatch)
+					{
+						PipelineUpdate(index);
+					}
+					previous.gradients->push();
+					previous.doorbell.ring();
+					stage.spare.push_back(std::move(stash));
+				}
+				else
+				{
+					stage.doorbell.wait(seen);
+				}
+			}
+		}
+		catch (...)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_pipeline->errorMutex);
+				m_pipeline->error = std::current_exception();
+			}
+			m_pipeline->failed.store(true);
+			for (std::unique_ptr<PipelineStage>& other : m_pipeline->stages)
+			{
+				other->doorbell.ring();
+			}
+		}
+	}
+
+	void NetworkTrainer::PipelineForward(int32_t index, PipelineStash& stash)
+	{
+		// Layer by layer, with the tiling of Network::EvaluateBatch. Each
+		// sample gets the same sums as Network::Evaluate.
+		PipelineStage const& stage = *m_pipeline->stages[index];
+		for (int32_t layer = stage.firstLayer; layer < stage.endLayer; ++layer)
+		{
+			int32_t const k = layer - stage.firstLayer;
+			int32_t const numActual = m_pNetwork->m_layerSizes[layer];
+			int32_t const numNext = m_pNetwork->m_layerSizes[layer + 1];
+			Matrix const& weights = m_pNetwork->m_weightsByLayer[layer];
+			const double* biasRow = weights.data() + numActual * numNext;
+			bool const softmaxLayer = layer + 1 == m_pNetwork->m_numLayers - 1 && m_pNetwork->m_softmaxOutput;
+			std::fill_n(stash.activations[k].data(), stash.count * numNext, 0.0);
+			kernels::multiplyTransposedAddBatch(weights.data(), stash.values[k].data(), stash.activations[k].data(),
+				stash.count, numActual, numNext, m_pNetwork->m_batchTiling);
+			for (int32_t sample = 0; sample < stash.count; ++sample)
+			{
+				double* nextActivations = stash.activations[k].data() + sample * numNext;
+				double* nextValues = stash.values[k + 1].data() + sample * numNext;
+				if (softmaxLayer)
+				{
+					for (int32_t nextIdx = 0; nextIdx < numNext; ++nextIdx)
+					{
+						nextActivations[nextIdx] += biasRow[nextIdx];
+					}
+					Network::softmax(nextActivations, nextValues, numNext);
+				}
+				else
+				{
+					m_pNetwork->activationFunction(layer + 1).evaluateLayer(nextActivations, nextValues, biasRow, numNext);
+				}
+			}
+		}
+	}
+
+	void NetworkTrainer::PipelineBackward(int32_t index, PipelineStash& stash, const Matrix& errorGradients,
+		bool derivativeApplied, Matrix* output)
+	{
+		// One sample at a time, in order, so that the deltas get the same sums
+		// as Backpropagate
+		PipelineStage& stage = *m_pipeline->stages[index];
+		int32_t const numStageLayers = stage.endLayer - stage.firstLayer;
+		int32_t const numLast = m_pNetwork->m_layerSizes[stage.endLayer];
+		for (int32_t sample = 0; sample < stash.count; ++sample)
+		{
+			double* lastErrorGradients = stage.errorGradients.back().data();
+			std::copy_n(errorGradients.data() + sample * numLast, numLast, lastErrorGradients);
+			if (!derivativeApplied)
+			{
+				m_pNetwork->activationFunction(stage.endLayer).multiplyDerivative(
+					stash.activations.back().data() + sample * numLast, stash.values.back().data() + sample * numLast,
+					lastErrorGradients, numLast);
+			}
+
+			for (int32_t k = numStageLayers - 1; k >= 0; --k)
+			{
+				int32_t const layer = stage.firstLayer + k;
+				int32_t const numActual = m_pNetwork->m_layerSizes[layer];
+				int32_t const numNext = m_pNetwork->m_layerSizes[layer + 1];
+				const double* weights = m_pNetwork->m_weightsByLayer[layer].data();
+				const double* actualValues = stash.values[k].data() + sample * numActual;
+				const double* nextErrorGradients = stage.errorGradients[k].data();
+
+				// Weight error gradients, one row per non-zero neuron and the bias
+				double* deltas = m_deltas[layer].data();
+				for (int32_t actualIdx = 0; actualIdx < numActual; ++actualIdx)
+				{
+					if (actualValues[actualIdx] != 0.0)
+					{
+						AccumulateDeltas(actualValues[actualIdx], nextErrorGradients, deltas + actualIdx * numNext, numNext);
+					}
+				}
+				AccumulateDeltas(1.0, nextErrorGradients, deltas + numActual * numNext, numNext);
+
+				// Error gradients of ``layer``, those of the first layer of the
+				// stage are finished by the previous stage
+				if (k > 0)
+				{
+					double* actualErrorGradients = stage.errorGradients[k - 1].data();
+					kernels::multiply(weights, nextErrorGradients, actualErrorGradients, numActual, numNext);
+					m_pNetwork->activationFunction(layer).multiplyDerivative(
+						stash.activations[k - 1].data() + sample * numActual, actualValues, actualErrorGradients, numActual);
+				}
+				else if (output != nullptr)
+				{
+					kernels::multiply(weights, nextErrorGradients, output->data() + sample * numActual, numActual, numNext);
+				}
+			}
+		}
+	}
+
+	void NetworkTrainer::PipelineSend(int32_t index, const PipelineStash& stash)
+	{
+		PipelineStage& next = *m_pipeline->stages[index + 1];
+		assert(!next.input->full());
+		PipelineMessage& message = next.input->back();
+		message.count = stash.count;
+		message.lastOfMiniBatch = stash.lastOfMiniBatch;
+		std::copy_n(stash.values.back().data(), stash.count * message.values.cols(), message.values.data());
+		next.input->push();
+		next.doorbell.ring();
+	}
+
+	void NetworkTrainer::PipelineUpdate(int32_t index)
+	{
+		// Same as UpdateWeights, on the layers of the stage
+		PipelineStage const& stage = *m_pipeline->stages[index];
+		for (int32_t layer = stage.firstLayer; layer < stage.endLayer; ++layer)
+		{
+			m_optimizer->update(layer, m_pNetwork->m_weightsByLayer[layer], m_deltas[layer]);
+			m_deltas[layer].fill(0.0);
+		}
+	}
+
+	void NetworkTrainer::AddSquaredErrors(std::vector<int32_t> const& expectedOutputs, double& MSE) const
+	{
+		int32_t const outputLayer = m_pNetwork->m_numLayers - 1;
+		for (int32_t outputIdx = 0; outputIdx < m_pNetwork->m_numOutputs; ++outputIdx)
+		{
+			double const squaredError = pow((m_pNetwork->getValue(outputLayer, outputIdx) - expectedOutputs[outputIdx]), 2);
+			MSE += m_reductionQuantum > 0.0 ? kernels::quantize(squaredError, m_reductionQuantum) : squaredError;
+		}
+	}
+
+	const Matrix* NetworkTrainer::FrozenFeatures(TrainingSet const& trainingSet)
+	{
+		if (m_frozenLayers == 0 || trainingSet.empty())
+		{
+			return nullptr;
+		}
+		for (FrozenFeatureCache const& cache : m_frozenFeatures)
+		{
+			if (cache.m_pSet == &trainingSet && cache.m_features.rows() == static_cast<int>(trainingSet.size()))
+			{
+				return &cache.m_features;
+			}
+		}
+
+		// The frozen layers are evaluated once per entry, as Evaluate does
+		int32_t const numFeatures = m_pNetwork->m_layerSizes[m_frozenLayers];
+		Matrix features(static_cast<int>(trainingSet.size()), numFeatures);
+		for (std::size_t entry = 0; entry < trainingSet.size(); ++entry)
+		{
+			m_pNetwork->SetInput(trainingSet[entry].m_inputs);
+			m_pNetwork->EvaluateLayers(0, m_frozenLayers);
+			std::copy_n(m_pNetwork->values(m_frozenLayers), numFeatures, features.data() + entry * numFeatures);
+		}
+		m_frozenFeatures.push_back({ &trainingSet, std::move(features) });
+
+		std::size_t bytes = 0;
+		for (FrozenFeatureCache const& cache : m_frozenFeatures)
+		{
+			bytes += cache.m_features.byteSize();
+		}
+		m_frozenFeaturesMemory.update(bytes);
+		return &m_frozenFeatures.back().m_features;
+	}
+
+	void NetworkTrainer::ClearFrozenFeatures()
+	{
+		m_frozenFeatures.clear();
+		m_frozenFeaturesMemory.update(0);
+	}
+
+	const Matrix* NetworkTrainer::DistillationTargets(TrainingSet const& trainingSet)
+	{
+		if (!m_pTeacher || trainingSet.empty())
+		{
+			return nullptr;
+		}
+		if (m_pDistilledSet == &trainingSet && m_distillationTargets->rows() == static_cast<int>(trainingSet.size()))
+		{
+			return &*m_distillationTargets;
+		}
+
+		// Teacher outputs evaluated by batches, then blended with the
+		// expected outputs
+		constexpr std::size_t BatchSize = 256;
+		int32_t const numInputs = m_pTeacher->m_numInputs;
+		int32_t const numOutputs = m_pNetwork->m_numOutputs;
+		Matrix& targets = m_distillationTargets.emplace(static_cast<int>(trainingSet.size()), numOutputs);
+		Matrix inputs(static_cast<int>(std::min(BatchSize, trainingSet.size())), numInputs);
+		Matrix outputs(inputs.rows(), numOutputs);
+		for (std::size_t first = 0; first < trainingSet.size(); first += inputs.rows())
+		{
+			std::size_t const count = std::min<std::size_t>(inputs.rows(), trainingSet.size() - first);
+			for (std::size_t b = 0; b < count; ++b)
+			{
+				std::ranges::copy(trainingSet[first + b].m_inputs, inputs.data() + b * numInputs);
+			}
+			m_pTeacher->EvaluateBatch(inputs, outputs);
+			for (std::size_t b = 0; b < count; ++b)
+			{
+				std::vector<int32_t> const& expectedOutputs = trainingSet[first + b].m_expectedOutputs;
+				double* row = targets.data() + (first + b) * numOutputs;
+				for (int32_t outputIdx = 0; outputIdx < numOutputs; ++outputIdx)
+				{
+					row[outputIdx] = m_teacherWeight * outputs(static_cast<int>(b), outputIdx)
+						+ (1.0 - m_teacherWeight) * expectedOutputs[outputIdx];
+				}
+			}
+		}
+		m_pDistilledSet = &trainingSet;
+		m_distillationMemory.update(targets.byteSize());
+		return &targets;
+	}
+
+	void NetworkTrainer::GetSetAccuracyAndMSE(TrainingSet const& trainingSet, double& accuracy, double& MSE,
+		const Matrix* features) const
+	{
+		accuracy = 0;
+		MSE = 0;
+
+		double numIncorrectResults = 0;
+		for (std::size_t entry = 0; entry < trainingSet.size(); ++entry)
+		{
+			TrainingEntry const& trainingEntry = trainingSet[entry];
+			if (features)
+			{
+				m_pNetwork->EvaluateFrom(m_frozenLayers,
+					{ features->data() + entry * features->cols(), static_cast<std::size_t>(features->cols()) });
+			}
+			else
+			{
+				m_pNetwork->Evaluate(trainingEntry.m_inputs);
+			}
+
+			// Check if the network outputs match the expected outputs
+			bool correctResult = m_loss->isCorrect(*m_pNetwork, trainingEntry.m_expectedOutputs);
+			AddSquaredErrors(trainingEntry.m_expectedOutputs, MSE);
 
 			if (!correctResult)
 			{
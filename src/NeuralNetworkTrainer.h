@@ -9,7 +9,17 @@
 #pragma once
 
 #include "NeuralNetwork.h"
+#include "Kernels.h"
+#include "Augmentation.h"
+#include "DataParallel.h"
+#include "Optimizer.h"
+#include "LearningRateSchedule.h"
+#include "LossFunctions.h"
+#include <deque>
 #include <fstream>
+#include <optional>
+#include <random>
+#include <utility>
 
 namespace bpn
 {
@@ -26,6 +36,11 @@ namespace bpn
 		TrainingSet m_trainingSet;
 		TrainingSet m_generalizationSet;
 		TrainingSet m_validationSet;
+
+		// Accounts the entries of the three sets, after they changed
+		void updateMemory();
+
+		MemoryTracker::Registration m_memory{ MemoryTracker::Category::dataset };
 	};
 
 	//-------------------------------------------------------------------------
@@ -40,40 +55,261 @@ namespace bpn
 			double      m_learningRate;
 			double      m_momentum;
 			bool        m_useBatchLearning;
+			uint64_t    m_miniBatchSize;      // Batch learning, samples per weight update, 0 for the whole epoch
+			std::string m_optimizer;
+			std::string m_learningRateSchedule;
+			uint64_t    m_warmupEpochs;
+			std::string m_loss;
+			std::string m_augmentation;        // see Augmenter::deserialize, ``none`` to disable
+			int32_t     m_augmentationThreads;
+			int32_t     m_pipelineStages;      // Batch learning, threads owning a group of layers each, 1 to disable
+			int32_t     m_pipelineMicroBatch;  // Samples flowing through the pipeline at once
+			std::string m_pipelineSchedule;    // ``1F1B`` or ``GPipe``
+			bool        m_deterministicReduction; // Sums independent of the processes and their order, see ReductionQuantum
+			int32_t     m_frozenLayers;        // Layers of weights from the input left untrained, 0 to disable
+			double      m_importanceSampling;  // Fraction of the training set drawn per epoch by loss, 0 to disable
+			bool        m_resumeSchedule;      // The schedule carries on from the epochs of the optimizer state
 
 			// Stopping conditions
 			uint64_t    m_maxEpochs;
 			double      m_desiredAccuracy;
+			uint64_t    m_patience;         // Early stopping, 0 to disable
 
 			// Verbosity
 			int32_t     m_verbosity;
 		};
 
+		/**
+		 * Deterministic reductions round every term of the weight error
+		 * gradients and of the squared errors to a multiple of this quantum.
+		 * The sums are then exact, whatever the order of the samples, the
+		 * threads and the processes, as long as they stay below 2^53
+		 * quantums (2^21).
+		 */
+		static constexpr double ReductionQuantum = 0x1p-32;
+
+		/**
+		 * Importance sampling draws every entry with a probability mixing
+		 * its share of the losses of the training set and, for this
+		 * fraction, a uniform one : the easy entries are still revisited
+		 * from time to time, and no weight exceeds 1 / ImportanceUniformShare.
+		 */
+		static constexpr double ImportanceUniformShare = 0.2;
+
+		// Chunks of augmented entries prepared ahead per augmentation thread
+		static constexpr int32_t AugmentationChunksPerThread = 4;
+
 	public:
 
 		NetworkTrainer(Settings const& settings, Network* pNetwork);
+		~NetworkTrainer();
 
 		void Train(TrainingData const& trainingData);
 
+		/**
+		 * Steps of ``Train``, for callers interleaving the training of
+		 * several networks : ``BeginTraining`` resets the training state,
+		 * ``TrainEpochs`` trains for at most ``epochs`` more epochs and returns
+		 * false once a stopping condition is met, ``EndTraining`` restores the
+		 * best weights and measures the validation set accuracy.
+		 */
+		void BeginTraining();
+		bool TrainEpochs(TrainingData const& trainingData, uint64_t epochs);
+		void EndTraining(TrainingData const& trainingData);
+
+		inline uint64_t getCurrentEpoch() const { return m_currentEpoch; }
+		inline double getTrainingSetAccuracy() const { return m_trainingSetAccuracy; }
+		inline double getGeneralizationSetAccuracy() const { return m_generalizationSetAccuracy; }
+		inline double getGeneralizationSetMSE() const { return m_generalizationSetMSE; }
+		inline double getValidationSetAccuracy() const { return m_validationSetAccuracy; }
+		inline double getValidationSetMSE() const { return m_validationSetMSE; }
+
+		/**
+		 * Magnitude pruning of the trained network (see Network::prune),
+		 * followed by ``retrainEpochs`` epochs of training with the pruned
+		 * weights held at 0. The pruned layers are then compressed and the
+		 * sparsity, accuracy delta and speedup against the dense path are
+		 * reported.
+		 */
+		void Prune(TrainingData const& trainingData, double threshold, double sparsity, uint64_t retrainEpochs);
+
+		/**
+		 * Knowledge distillation : the network is trained towards
+		 * ``teacherWeight`` times the outputs of ``pTeacher`` plus
+		 * 1 - ``teacherWeight`` times the expected outputs. The outputs of
+		 * the teacher are computed once per training set. ``EndTraining``
+		 * then compares the accuracy and the inference speed of both
+		 * networks on the validation set. Null stops the distillation.
+		 */
+		void setTeacher(Network* pTeacher, double teacherWeight);
+
+		/**
+		 * Data parallel training : the trainer of every process holds its own
+		 * shard of the training set, the error gradients are summed over the
+		 * processes before every weight update and the epoch statistics are
+		 * summed for the stopping conditions. Batch learning only.
+		 */
+		void setCommunicator(Communicator* pCommunicator);
+
+		/**
+		 * Optimizer state of the network (momentum, moments...), to resume
+		 * its training later on new data. ``loadOptimizerState`` throws if
+		 * the file was saved for another optimizer or other layer sizes.
+		 * The file also holds the number of epochs trained so far, from
+		 * which the learning rate schedule and the augmentation resume with
+		 * ``m_resumeSchedule`` : ``loadOptimizerState`` then throws if the
+		 * schedule has no learning rate left for this training.
+		 */
+		void saveOptimizerState(std::string const& path) const;
+		void loadOptimizerState(std::string const& path);
+
+		/**
+		 * Doubles exchanged per process by the data parallel training of a
+		 * network with the given layer sizes, see ``launchProcesses``.
+		 */
+		static std::size_t communicationSize(const std::vector<int>& layerSizes);
+
+		/**
+		 * Trains for ``epochs`` epochs without evaluating the generalization
+		 * set and returns the number of training samples processed per
+		 * second, by all the processes when data parallel.
+		 */
+		double Benchmark(TrainingSet const& trainingSet, uint64_t epochs);
+
+		/**
+		 * Bytes held by a trainer of a network with the given layer sizes
+		 * training on ``numEntries`` entries at most : deltas of batch
+		 * learning, optimizer state, best weights of early stopping, cached
+		 * frozen features, distillation targets (with a teacher) and
+		 * augmentation chunks.
+		 */
+		static std::size_t plannedFootprint(const std::vector<int>& layerSizes, Settings const& settings,
+			std::size_t numEntries, bool distillation);
+
+		/**
+		 * Pipeline stages of a network with the given layer sizes : first
+		 * layer of weights of each of the ``numStages`` stages, followed by
+		 * the number of layers of weights. The stages are contiguous groups
+		 * of layers with about the same number of weights.
+		 */
+		static std::vector<int32_t> partitionLayers(const std::vector<int>& layerSizes, int32_t numStages);
+
 	private:
 
-		inline double getOutputErrorGradient(double desiredValue, const Neuron& outputNeuron) const
+		void RunEpoch(TrainingSet const& trainingSet);
+		// ``features`` are the cached values of the last frozen layer for
+		// this entry, the whole network is evaluated when null
+		// ``sampleWeight`` scales the error gradients of the entry, which are
+		// computed against the soft ``targets`` of distillation when not null
+		void TrainOnEntry(TrainingEntry const& trainingEntry, double& incorrectEntries, double& MSE,
+			const double* features = nullptr, const double* targets = nullptr, double sampleWeight = 1.0);
+		void Backpropagate(std::vector<int32_t> const& expectedOutputs, const double* targets, double sampleWeight);
+		void UpdateWeights();
+		bool StopRequested() const;
+
+		// deltas += alpha * errorGradients, quantized by deterministic reductions
+		inline void AccumulateDeltas(double alpha, const double* errorGradients, double* deltas, std::size_t n) const
 		{
-			// TODO : mean square error is hard coded here so we have 
-			// a factor : desiredValue - outputNeuron.value;
-			double derivative = m_pNetwork->m_sigma->evalDerivative(
-				outputNeuron.activation, outputNeuron.value);
-			return derivative * (desiredValue - outputNeuron.value);
-			//return outputValue * ( 1.0 - outputValue ) * ( desiredValue - outputValue ); 
+			if (m_reductionQuantum > 0.0)
+			{
+				kernels::axpyQuantized(alpha, errorGradients, deltas, n, m_reductionQuantum);
+			}
+			else
+			{
+				kernels::axpy(alpha, errorGradients, deltas, n);
+			}
 		}
-		//double GetHiddenErrorGradient( int32_t hiddenIdx ) const;
-		double getErrorGradient(int32_t layer, int32_t index) const;
 
-		void RunEpoch(TrainingSet const& trainingSet);
-		void Backpropagate(std::vector<int32_t> const& expectedOutputs);
-		void UpdateWeights();
+		// Adds the squared errors of the outputs of the last evaluation to ``MSE``
+		void AddSquaredErrors(std::vector<int32_t> const& expectedOutputs, double& MSE) const;
+
+		// Stochastic learning : back-propagation and weight update in a single
+		// sweep per layer, every row of weights is read for the error
+		// gradients of the layer then updated right away.
+		void BackpropagateAndUpdate(std::vector<int32_t> const& expectedOutputs, const double* targets, double sampleWeight);
 
-		void GetSetAccuracyAndMSE(TrainingSet const& trainingSet, double& accuracy, double& mse) const;
+		// Output error gradients of the last evaluation, times ``sampleWeight``
+		void OutputErrorGradients(std::vector<int32_t> const& expectedOutputs, const double* targets, double sampleWeight);
+
+		/**
+		 * Importance sampling : draws, with replacement, m_importanceSampling
+		 * times ``numEntries`` entries by their last squared errors in
+		 * m_sampledEntries, with the unbiasing weights 1 / (numEntries * p)
+		 * in m_sampledWeights. Every entry is drawn once, in order and with
+		 * weight 1, while the losses are not all known.
+		 */
+		void SampleByImportance(std::size_t numEntries);
+
+		// Sparse input fast path of the first layer : only the rows of the
+		// non-zero inputs get a weight error gradient and an update. In
+		// stochastic mode, the skipped momentum steps are applied lazily.
+		inline bool useSparseFirstLayer() const
+		{
+			return m_pNetwork->m_sparseInput && (m_useBatchLearning || m_optimizer->supportsLazyUpdates());
+		}
+		void BackpropagateSparseFirstLayer();
+
+		// Epoch of the learning rate schedule and of the augmentation
+		inline uint64_t scheduleEpoch() const
+		{
+			return (m_resumeSchedule ? m_epochOffset : 0) + m_currentEpoch;
+		}
+
+		// Stochastic learning : applies the pending steps of the rows of the
+		// first layer updated by the sample set as input, before the forward
+		// pass reads them
+		void CatchUpFirstLayer();
+		void FlushLazyUpdates(uint64_t step);
+
+		// Pipeline parallel training, batch learning only. Every stage owns a
+		// group of layers and runs on its own thread, stage 0 on the training
+		// thread. Micro-batches flow forward and their error gradients flow
+		// back through queues, and every stage updates its own layers at the
+		// end of a mini-batch. The results are the same as without pipeline.
+		struct PipelineStash;
+		struct PipelineMessage;
+		struct PipelineStage;
+		struct Pipeline;
+		void StartPipeline(std::size_t numSamples);
+		void StopPipeline();
+		void CheckPipeline() const;
+		void RunPipelinedEpoch(TrainingSet const& trainingSet, double& incorrectEntries, double& MSE);
+		void RunPipelineStage(int32_t stage);
+		void PipelineForward(int32_t stage, PipelineStash& stash);
+		// ``errorGradients`` are the back-propagated gradients of the last
+		// layer of the stage (micro-batch x layer size), before the
+		// derivative of the activation function unless ``derivativeApplied``.
+		// The gradients to hand to the previous stage go in ``output``.
+		void PipelineBackward(int32_t stage, PipelineStash& stash, const Matrix& errorGradients,
+			bool derivativeApplied, Matrix* output);
+		void PipelineSend(int32_t stage, const PipelineStash& stash);
+		void PipelineUpdate(int32_t stage);
+
+		void SaveBestWeights();
+		void RestoreBestWeights();
+
+		/**
+		 * Frozen layers : values of the last frozen layer for every entry of
+		 * ``trainingSet`` (one row each), computed on the first call for this
+		 * set and kept until the next ``BeginTraining``. Null without frozen
+		 * layers.
+		 */
+		const Matrix* FrozenFeatures(TrainingSet const& trainingSet);
+		void ClearFrozenFeatures();
+
+		/**
+		 * Distillation : blended targets of every entry of ``trainingSet``
+		 * (one row each), computed on the first call for this set. Null
+		 * without teacher.
+		 */
+		const Matrix* DistillationTargets(TrainingSet const& trainingSet);
+		void ReportDistillation(TrainingSet const& validationSet);
+
+		// Seconds per sample of the single and batch evaluations of ``trainingSet``
+		static std::pair<double, double> TimeInference(Network& network, TrainingSet const& trainingSet);
+
+		void GetSetAccuracyAndMSE(TrainingSet const& trainingSet, double& accuracy, double& mse,
+			const Matrix* features = nullptr) const;
 
 	private:
 
@@ -86,14 +322,67 @@ namespace bpn
 
 		double                            m_desiredAccuracy;      // Target accuracy for training
 		uint64_t                          m_maxEpochs;            // Max number of training epochs
+		uint64_t                          m_patience;             // Epochs without improvement before stopping
 		bool                              m_useBatchLearning;     // Should we use batch learning
+		uint64_t                          m_miniBatchSize;        // Samples per weight update, 0 for the whole epoch
+		Communicator*                     m_pCommunicator;        // Data parallel training, may be null
+		int32_t                           m_pipelineStages;       // 1 without pipeline
+		int32_t                           m_pipelineMicroBatch;
+		bool                              m_pipelineGPipe;        // GPipe schedule, 1F1B otherwise
+		double                            m_reductionQuantum;     // ReductionQuantum, 0 unless deterministic
+		int32_t                           m_frozenLayers;         // Layers of weights neither back-propagated nor updated
+		std::unique_ptr<Pipeline>         m_pipeline;             // Started by the first pipelined epoch
 
-		// m_deltas[i] : deltas from layer i to i+1
+		// m_deltas[i] : weight error gradients from layer i to i+1, summed
+		// over the mini-batch (batch learning only)
 		std::vector<Matrix>               m_deltas;
-		// m_errorGradients[i] error gradients on layer i
-		std::vector< std::vector<double> > m_errorGradients;
+		std::unique_ptr<Optimizer>        m_optimizer;            // Applies m_deltas to the weights
+		std::unique_ptr<LearningRateSchedule> m_schedule;         // Learning rate of each epoch
+		std::unique_ptr<LossFunction>     m_loss;                 // Gives the output error gradients
+		std::unique_ptr<AugmentationPipeline> m_augmentation;     // Distorts the training set, may be null
+		uint64_t                          m_step;                 // Number of weight updates so far
+		// m_rowLastStep[i] : last step applied on row i of the first layer weights
+		std::vector<uint64_t>             m_rowLastStep;
+		MemoryTracker::Registration       m_stateMemory{ MemoryTracker::Category::trainer };
+
+		// Values of the last frozen layer for the entries of a set
+		struct FrozenFeatureCache
+		{
+			const TrainingSet* m_pSet;
+			Matrix             m_features;
+		};
+		std::deque<FrozenFeatureCache>    m_frozenFeatures;
+		MemoryTracker::Registration       m_frozenFeaturesMemory{ MemoryTracker::Category::trainer };
+
+		// Importance sampling
+		double                            m_importanceSampling;   // Fraction of the entries drawn per epoch, 0 to disable
+		std::mt19937_64                   m_importanceGenerator;
+		// m_sampleLosses[i] : squared errors of the last pass on entry i, for
+		// any loss. With the cross entropy on a softmax output, they are the
+		// squared norm of the output error gradients (t - y), the quantity
+		// that importance sampling should follow.
+		std::vector<double>               m_sampleLosses;
+		std::vector<uint32_t>             m_sampledEntries;       // Entries of the epoch, in training order
+		std::vector<double>               m_sampledWeights;       // Unbiasing weight of each of them
+
+		// Knowledge distillation
+		Network*                          m_pTeacher;             // May be null
+		double                            m_teacherWeight;        // Share of the teacher outputs in the targets
+		const TrainingSet*                m_pDistilledSet;        // Set of m_distillationTargets
+		std::optional<Matrix>             m_distillationTargets;
+		MemoryTracker::Registration       m_distillationMemory{ MemoryTracker::Category::trainer };
+
+		// Early stopping : weights with the lowest generalization MSE so far
+		std::vector<Matrix>               m_bestWeights;
+		uint64_t                          m_bestEpoch;
+		double                            m_bestGeneralizationMSE;
+		uint64_t                          m_epochsWithoutImprovement;
+		bool                              m_finished;             // A stopping condition was met
+		MemoryTracker::Registration       m_bestWeightsMemory{ MemoryTracker::Category::trainer };
 
 		uint64_t                          m_currentEpoch;             // Epoch counter
+		uint64_t                          m_epochOffset;              // Epochs trained before, read with the optimizer state
+		bool                              m_resumeSchedule;
 		double                            m_trainingSetAccuracy;
 		double                            m_validationSetAccuracy;
 		double                            m_generalizationSetAccuracy;
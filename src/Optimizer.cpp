@@ -0,0 +1,144 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+
+#include "Optimizer.h"
+#include "Parameters.h"
+#include <algorithm>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+
+namespace bpn
+{
+	namespace
+	{
+		constexpr char stateMagic[8] = { 'B', 'P', 'N', 'O', 'P', 'T', 'I', 'M' };
+		constexpr uint32_t stateVersion = 1;
+
+		template<typename T>
+		void write(std::ostream& os, const T& value)
+		{
+			os.write(reinterpret_cast<const char*>(&value), sizeof(T));
+		}
+
+		template<typename T>
+		T read(std::istream& is)
+		{
+			T value{};
+			if (!is.read(reinterpret_cast<char*>(&value), sizeof(T)))
+			{
+				throw std::runtime_error("Truncated optimizer state");
+			}
+			return value;
+		}
+	}
+
+	void Optimizer::saveState(std::ostream& os) const
+	{
+		// magic, version, name, then every buffer and the step state
+		os.write(stateMagic, sizeof(stateMagic));
+		write(os, stateVersion);
+		std::string const name = serialize();
+		write(os, static_cast<uint32_t>(name.size()));
+		os.write(name.data(), name.size());
+		write(os, static_cast<uint32_t>(m_state.size()));
+		for (const std::vector<Matrix>& buffer : m_state)
+		{
+			write(os, static_cast<uint32_t>(buffer.size()));
+			for (const Matrix& m : buffer)
+			{
+				write(os, static_cast<int32_t>(m.rows()));
+				write(os, static_cast<int32_t>(m.cols()));
+				os.write(reinterpret_cast<const char*>(m.data()), m.byteSize());
+			}
+		}
+		std::vector<double> const values = stepState();
+		write(os, static_cast<uint32_t>(values.size()));
+		os.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(double));
+	}
+
+	void Optimizer::loadState(std::istream& is)
+	{
+		char magic[sizeof(stateMagic)] = {};
+		is.read(magic, sizeof(magic));
+		if (!std::equal(magic, magic + sizeof(magic), stateMagic) || read<uint32_t>(is) != stateVersion)
+		{
+			throw std::runtime_error("Not an optimizer state");
+		}
+		std::string name(read<uint32_t>(is), '\0');
+		is.read(name.data(), name.size());
+		if (name != serialize())
+		{
+			throw std::runtime_error(std::format("Optimizer state of `{}`, expected `{}`", name, serialize()));
+		}
+
+		// Read aside, the current state is kept if anything does not match
+		std::vector<std::vector<Matrix>> state = m_state;
+		if (read<uint32_t>(is) != state.size())
+		{
+			throw std::runtime_error("Optimizer state of another optimizer");
+		}
+		for (std::vector<Matrix>& buffer : state)
+		{
+			if (read<uint32_t>(is) != buffer.size())
+			{
+				throw std::runtime_error("Optimizer state of another network");
+			}
+			for (Matrix& m : buffer)
+			{
+				int32_t const rows = read<int32_t>(is);
+				int32_t const cols = read<int32_t>(is);
+				if (rows != m.rows() || cols != m.cols()
+					|| !is.read(reinterpret_cast<char*>(m.data()), m.byteSize()))
+				{
+					throw std::runtime_error("Optimizer state of another network");
+				}
+			}
+		}
+		std::vector<double> values(read<uint32_t>(is));
+		if (values.size() != stepState().size()
+			|| !is.read(reinterpret_cast<char*>(values.data()), values.size() * sizeof(double)))
+		{
+			throw std::runtime_error("Truncated optimizer state");
+		}
+
+		for (std::size_t b = 0; b < state.size(); ++b)
+		{
+			for (std::size_t layer = 0; layer < state[b].size(); ++layer)
+			{
+				std::copy_n(state[b][layer].data(), state[b][layer].size(), m_state[b][layer].data());
+			}
+		}
+		setStepState(values);
+	}
+
+	std::unique_ptr<Optimizer> Optimizer::deserialize(std::string_view s, double learningRate, double momentum)
+	{
+		std::string_view const name = s.substr(0, s.find('('));
+		std::vector<double> const parameters = parseParameters(s, "optimizer");
+
+		if (name == "SGD")
+		{
+			return std::make_unique<SGD>(learningRate, momentum);
+		}
+		else if (name == "Nesterov")
+		{
+			return std::make_unique<Nesterov>(learningRate, momentum);
+		}
+		else if (name == "RMSProp")
+		{
+			return std::make_unique<RMSProp>(learningRate, parameters.size() > 0 ? parameters[0] : 0.9);
+		}
+		else if (name == "Adam")
+		{
+			return std::make_unique<Adam>(learningRate,
+				parameters.size() > 0 ? parameters[0] : 0.9,
+				parameters.size() > 1 ? parameters[1] : 0.999);
+		}
+
+		throw std::runtime_error(std::format("Unknown optimizer `{}`", s));
+	}
+}
@@ -0,0 +1,448 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+// Weight update rules used by the trainer.
+//
+// Gradients handed to an optimizer are ``error gradients`` as computed by
+// the back-propagation: they already point in the descent direction, so
+// every rule *adds* its step to the weights.
+
+#pragma once
+
+#include "Matrix.h"
+#include <cmath>
+#include <cstddef>
+#include <format>
+#include <iosfwd>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace bpn
+{
+	class Optimizer
+	{
+	public:
+		explicit Optimizer(double learningRate) : m_learningRate{ learningRate }
+		{ }
+
+		virtual ~Optimizer() = default;
+
+		/**
+		 * Allocates the optimizer state, one matrix per state buffer and per
+		 * layer with exactly the same shape as the weights.
+		 */
+		void initialize(const std::vector<Matrix>& weightsByLayer)
+		{
+			m_state.clear();
+			for (int32_t buffer = 0; buffer < numStateBuffers(); ++buffer)
+			{
+				m_state.emplace_back();
+				for (const Matrix& weights : weightsByLayer)
+				{
+					m_state.back().emplace_back(weights.rows(), weights.cols(), 0.0);
+				}
+			}
+		}
+
+		/**
+		 * Must be called once before the layers of a given step are updated.
+		 */
+		virtual void beginStep()
+		{ }
+
+		/**
+		 * Applies one update step on the weights of ``layer``.
+		 */
+		void update(int32_t layer, Matrix& weights, const Matrix& gradients)
+		{
+			updateRange(layer, weights, gradients, 0, weights.size());
+		}
+
+		/**
+		 * Applies one update step on the elements [begin, end) of the weights
+		 * of ``layer`` (row major order, so a range of rows is contiguous).
+		 */
+		virtual void updateRange(int32_t layer, Matrix& weights, const Matrix& gradients,
+			std::size_t begin, std::size_t end) = 0;
+
+		/**
+		 * Applies one update step on the row ``row`` of the weights of
+		 * ``layer``, whose gradients are ``value * errorGradients[c]`` for
+		 * every column c. This is the fused back-propagation step of
+		 * stochastic learning : the gradients are never stored.
+		 */
+		virtual void updateRow(int32_t layer, Matrix& weights, std::size_t row,
+			double value, const double* errorGradients) = 0;
+
+		/**
+		 * Whether ``skipSteps`` is supported, i.e. whether a series of steps
+		 * with a null gradient has a closed form for this optimizer.
+		 */
+		virtual bool supportsLazyUpdates() const
+		{
+			return false;
+		}
+
+		/**
+		 * Applies at once ``steps`` update steps with a null gradient on the
+		 * elements [begin, end) of the weights of ``layer``. Lets the trainer
+		 * skip rows whose gradient is known to be null and catch up later.
+		 */
+		virtual void skipSteps(int32_t /*layer*/, Matrix& /*weights*/, std::size_t /*begin*/, std::size_t /*end*/, uint64_t /*steps*/)
+		{ }
+
+		/**
+		 * Number of weight-shaped buffers the optimizer keeps between steps.
+		 */
+		virtual int32_t numStateBuffers() const = 0;
+
+		/**
+		 * Representation of the optimizer as text.
+		 */
+		virtual std::string serialize() const = 0;
+
+		inline double learningRate() const
+		{
+			return m_learningRate;
+		}
+
+		inline void setLearningRate(double learningRate)
+		{
+			m_learningRate = learningRate;
+		}
+
+		std::size_t stateBytes() const
+		{
+			std::size_t bytes = 0;
+			for (const std::vector<Matrix>& buffer : m_state)
+			{
+				for (const Matrix& m : buffer)
+				{
+					bytes += m.byteSize();
+				}
+			}
+			return bytes;
+		}
+
+		/**
+		 * Writes the state buffers and the step dependent values of the
+		 * optimizer, in binary, so that a later training can resume with
+		 * ``loadState``.
+		 */
+		void saveState(std::ostream& os) const;
+
+		/**
+		 * Reads a state written by ``saveState``. Throws if it was written by
+		 * another optimizer or for weights of other shapes.
+		 */
+		void loadState(std::istream& is);
+
+		/**
+		 * Builds an optimizer from its text representation, for instance
+		 * ``SGD``, ``Nesterov``, ``RMSProp(0.9)`` or ``Adam(0.9,0.999)``.
+		 * ``momentum`` is the coefficient used by SGD and Nesterov.
+		 */
+		static std::unique_ptr<Optimizer> deserialize(std::string_view s, double learningRate, double momentum);
+
+	protected:
+		// Values besides the state buffers that depend on the steps so far
+		virtual std::vector<double> stepState() const
+		{
+			return {};
+		}
+
+		virtual void setStepState(std::span<const double>)
+		{ }
+
+		// mu + mu^2 + ... + mu^k
+		static double geometricSum(double mu, uint64_t k)
+		{
+			if (mu == 1.0)
+			{
+				return static_cast<double>(k);
+			}
+			return mu * (1.0 - std::pow(mu, static_cast<double>(k))) / (1.0 - mu);
+		}
+
+		// m_state[b][i] : state buffer ``b`` of the weights from layer i to i+1
+		std::vector< std::vector<Matrix> > m_state;
+		double                             m_learningRate;
+	};
+
+	/**
+	 * Optimizers updating every weight on its own : ``Derived`` provides
+	 * ``elementStep(layer)``, a function of the element index and of its
+	 * gradient that updates the state of this element and returns the step
+	 * to add to the weight. The loops over a range or a row are shared.
+	 */
+	template<typename Derived>
+	class ElementwiseOptimizer : public Optimizer
+	{
+	public:
+		using Optimizer::Optimizer;
+
+		void updateRange(int32_t layer, Matrix& weights, const Matrix& gradients,
+			std::size_t begin, std::size_t end) override
+		{
+			const double* g = gradients.data();
+			apply(layer, weights, begin, end, [g](std::size_t i) { return g[i]; });
+		}
+
+		void updateRow(int32_t layer, Matrix& weights, std::size_t row,
+			double value, const double* errorGradients) override
+		{
+			std::size_t const begin = row * weights.cols();
+			apply(layer, weights, begin, begin + weights.cols(),
+				[=](std::size_t i) { return value * errorGradients[i - begin]; });
+		}
+
+	private:
+		// One update step where ``gradient(i)`` is the gradient of element i
+		template<typename Gradient>
+		void apply(int32_t layer, Matrix& weights, std::size_t begin, std::size_t end, Gradient gradient)
+		{
+			auto step = static_cast<Derived&>(*this).elementStep(layer);
+			double* __restrict w = weights.data();
+			for (std::size_t i = begin; i < end; ++i)
+			{
+				w[i] += step(i, gradient(i));
+			}
+		}
+	};
+
+	class SGD : public ElementwiseOptimizer<SGD>
+	{
+		/**
+		 * v = momentum * v + learningRate * g
+		 * w = w + v
+		 */
+	public:
+		SGD(double learningRate, double momentum) : ElementwiseOptimizer(learningRate), momentum{ momentum }
+		{ }
+
+		bool supportsLazyUpdates() const override
+		{
+			return true;
+		}
+
+		/**
+		 * With g = 0 during k steps :
+		 *     w = w + v * (mu + mu^2 + ... + mu^k)
+		 *     v = v * mu^k
+		 */
+		void skipSteps(int32_t layer, Matrix& weights, std::size_t begin, std::size_t end, uint64_t steps) override
+		{
+			if (steps == 0)
+			{
+				return;
+			}
+			double const decay = std::pow(momentum, static_cast<double>(steps));
+			double const sum = geometricSum(momentum, steps);
+			double* __restrict w = weights.data();
+			double* __restrict v = m_state[0][layer].data();
+			for (std::size_t i = begin; i < end; ++i)
+			{
+				w[i] += v[i] * sum;
+				v[i] *= decay;
+			}
+		}
+
+		int32_t numStateBuffers() const override
+		{
+			return 1;
+		}
+
+		std::string serialize() const override
+		{
+			return "SGD";
+		}
+
+		const double momentum;
+
+	private:
+		friend class ElementwiseOptimizer<SGD>;
+
+		auto elementStep(int32_t layer)
+		{
+			return [v = m_state[0][layer].data(), lr = m_learningRate, mu = momentum](std::size_t i, double g)
+			{
+				v[i] = lr * g + mu * v[i];
+				return v[i];
+			};
+		}
+	};
+
+	class Nesterov : public ElementwiseOptimizer<Nesterov>
+	{
+		/**
+		 * Nesterov accelerated gradient, in its usual reformulation where the
+		 * look-ahead is applied to the step rather than to the weights.
+		 *
+		 * v = momentum * v + learningRate * g
+		 * w = w + momentum * v + learningRate * g
+		 */
+	public:
+		Nesterov(double learningRate, double momentum) : ElementwiseOptimizer(learningRate), momentum{ momentum }
+		{ }
+
+		bool supportsLazyUpdates() const override
+		{
+			return true;
+		}
+
+		/**
+		 * With g = 0 during k steps :
+		 *     w = w + v * (mu^2 + mu^3 + ... + mu^(k+1))
+		 *     v = v * mu^k
+		 */
+		void skipSteps(int32_t layer, Matrix& weights, std::size_t begin, std::size_t end, uint64_t steps) override
+		{
+			if (steps == 0)
+			{
+				return;
+			}
+			double const decay = std::pow(momentum, static_cast<double>(steps));
+			double const sum = momentum * geometricSum(momentum, steps);
+			double* __restrict w = weights.data();
+			double* __restrict v = m_state[0][layer].data();
+			for (std::size_t i = begin; i < end; ++i)
+			{
+				w[i] += v[i] * sum;
+				v[i] *= decay;
+			}
+		}
+
+		int32_t numStateBuffers() const override
+		{
+			return 1;
+		}
+
+		std::string serialize() const override
+		{
+			return "Nesterov";
+		}
+
+		const double momentum;
+
+	private:
+		friend class ElementwiseOptimizer<Nesterov>;
+
+		auto elementStep(int32_t layer)
+		{
+			return [v = m_state[0][layer].data(), lr = m_learningRate, mu = momentum](std::size_t i, double g)
+			{
+				double const step = lr * g;
+				v[i] = step + mu * v[i];
+				return step + mu * v[i];
+			};
+		}
+	};
+
+	class RMSProp : public ElementwiseOptimizer<RMSProp>
+	{
+		/**
+		 * s = rho * s + (1 - rho) * g^2
+		 * w = w + learningRate * g / (sqrt(s) + epsilon)
+		 */
+	public:
+		RMSProp(double learningRate, double rho = 0.9) : ElementwiseOptimizer(learningRate), rho{ rho }
+		{ }
+
+		int32_t numStateBuffers() const override
+		{
+			return 1;
+		}
+
+		std::string serialize() const override
+		{
+			return std::format("RMSProp({})", rho);
+		}
+
+		const double rho;
+		static constexpr double epsilon = 1e-8;
+
+	private:
+		friend class ElementwiseOptimizer<RMSProp>;
+
+		auto elementStep(int32_t layer)
+		{
+			return [s = m_state[0][layer].data(), lr = m_learningRate, rho = rho](std::size_t i, double g)
+			{
+				s[i] = rho * s[i] + (1.0 - rho) * g * g;
+				return lr * g / (std::sqrt(s[i]) + epsilon);
+			};
+		}
+	};
+
+	class Adam : public ElementwiseOptimizer<Adam>
+	{
+		/**
+		 * m = beta1 * m + (1 - beta1) * g
+		 * v = beta2 * v + (1 - beta2) * g^2
+		 * w = w + learningRate * m' / (sqrt(v') + epsilon)
+		 *
+		 * where m' and v' are m and v corrected for their initialization bias
+		 * at step t : m' = m / (1 - beta1^t), v' = v / (1 - beta2^t).
+		 */
+	public:
+		Adam(double learningRate, double beta1 = 0.9, double beta2 = 0.999)
+			: ElementwiseOptimizer(learningRate), beta1{ beta1 }, beta2{ beta2 }
+		{ }
+
+		void beginStep() override
+		{
+			m_beta1Power *= beta1;
+			m_beta2Power *= beta2;
+		}
+
+		int32_t numStateBuffers() const override
+		{
+			return 2;
+		}
+
+		std::string serialize() const override
+		{
+			return std::format("Adam({},{})", beta1, beta2);
+		}
+
+		const double beta1;
+		const double beta2;
+		static constexpr double epsilon = 1e-8;
+
+	protected:
+		std::vector<double> stepState() const override
+		{
+			return { m_beta1Power, m_beta2Power };
+		}
+
+		void setStepState(std::span<const double> values) override
+		{
+			m_beta1Power = values[0];
+			m_beta2Power = values[1];
+		}
+
+	private:
+		friend class ElementwiseOptimizer<Adam>;
+
+		auto elementStep(int32_t layer)
+		{
+			// Bias corrections folded in the step size and epsilon
+			double const correction1 = 1.0 - m_beta1Power;
+			double const sqrtCorrection2 = std::sqrt(1.0 - m_beta2Power);
+			return [m = m_state[0][layer].data(), v = m_state[1][layer].data(), beta1 = beta1, beta2 = beta2,
+				stepSize = m_learningRate * sqrtCorrection2 / correction1, eps = epsilon * sqrtCorrection2](std::size_t i, double g)
+			{
+				m[i] = beta1 * m[i] + (1.0 - beta1) * g;
+				v[i] = beta2 * v[i] + (1.0 - beta2) * g * g;
+				return stepSize * m[i] / (std::sqrt(v[i]) + eps);
+			};
+		}
+
+		double   m_beta1Power = 1.0;
+		double   m_beta2Power = 1.0;
+	};
+}
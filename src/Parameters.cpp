@@ -0,0 +1,43 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+
+#include "Parameters.h"
+#include <charconv>
+#include <format>
+#include <stdexcept>
+
+namespace bpn
+{
+	std::vector<double> parseParameters(std::string_view s, std::string_view what)
+	{
+		std::vector<double> parameters;
+		std::size_t const open = s.find('(');
+		if (open == std::string_view::npos)
+		{
+			return parameters;
+		}
+
+		std::size_t const close = s.find(')', open);
+		if (close == std::string_view::npos)
+		{
+			throw std::runtime_error(std::format("Invalid {} `{}`", what, s));
+		}
+
+		const char* it = s.data() + open + 1;
+		const char* const end = s.data() + close;
+		while (it < end)
+		{
+			double value = 0;
+			auto [next, ec] = std::from_chars(it, end, value);
+			if (ec != std::errc())
+			{
+				throw std::runtime_error(std::format("Invalid {} parameters in `{}`", what, s));
+			}
+			parameters.push_back(value);
+			it = (next < end && *next == ',') ? next + 1 : next;
+		}
+		return parameters;
+	}
+}
@@ -0,0 +1,20 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+namespace bpn
+{
+	/**
+	 * Parameters between parentheses, e.g. ``Adam(0.9,0.999)`` gives
+	 * {0.9, 0.999}, and none without parentheses. Throws if the parameters
+	 * are not numbers or the parenthesis is not closed, with ``what``
+	 * (e.g. "optimizer") in the message.
+	 */
+	std::vector<double> parseParameters(std::string_view s, std::string_view what);
+}
@@ -0,0 +1,122 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+// Communication between the threads of a pipeline : lock-free queues with
+// a single producer and a single consumer, and a doorbell rung by the
+// producers so that a thread consuming several queues can sleep on one
+// value.
+
+#pragma once
+
+#include "ThreadPool.h"
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace bpn
+{
+	/**
+	 * Bounded queue between one producer and one consumer thread. The
+	 * elements are built once, as copies of a prototype, and reused : the
+	 * producer fills ``back()`` then calls ``push()``, the consumer reads
+	 * ``front()`` then calls ``pop()``. The producer must check ``full()``
+	 * and the consumer ``empty()`` beforehand.
+	 */
+	template<typename T>
+	class SpscQueue
+	{
+	public:
+		SpscQueue(std::size_t capacity, const T& prototype)
+			: m_elements(capacity, prototype)
+		{
+			assert(capacity > 0);
+		}
+
+		inline std::size_t capacity() const
+		{
+			return m_elements.size();
+		}
+
+		// Producer side
+		inline bool full() const
+		{
+			return m_tail.load(std::memory_order_relaxed) - m_head.load(std::memory_order_acquire) == capacity();
+		}
+
+		inline T& back()
+		{
+			return m_elements[m_tail.load(std::memory_order_relaxed) % capacity()];
+		}
+
+		inline void push()
+		{
+			m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+		// Consumer side
+		inline bool empty() const
+		{
+			return m_head.load(std::memory_order_relaxed) == m_tail.load(std::memory_order_acquire);
+		}
+
+		inline T& front()
+		{
+			return m_elements[m_head.load(std::memory_order_relaxed) % capacity()];
+		}
+
+		inline void pop()
+		{
+			m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+	private:
+		std::vector<T>                       m_elements;
+		alignas(64) std::atomic<std::size_t> m_head{ 0 };  // next element to consume
+		alignas(64) std::atomic<std::size_t> m_tail{ 0 };  // next element to produce
+	};
+
+	/**
+	 * Wakes up a consumer once something was pushed in one of its queues.
+	 * The consumer reads ``value()``, checks its queues, and if they are all
+	 * empty calls ``wait`` with the value read : a push in between makes it
+	 * return at once.
+	 */
+	class Doorbell
+	{
+		// Iterations spent spinning before sleeping in ``wait``
+		static constexpr uint32_t SpinIterations = 1u << 12;
+
+	public:
+		inline uint32_t value() const
+		{
+			return m_rings.load(std::memory_order_acquire);
+		}
+
+		inline void ring()
+		{
+			m_rings.fetch_add(1, std::memory_order_release);
+			m_rings.notify_one();
+		}
+
+		inline void wait(uint32_t seen) const
+		{
+			for (uint32_t spins = 0; m_rings.load(std::memory_order_acquire) == seen; ++spins)
+			{
+				if (spins < SpinIterations)
+				{
+					cpuRelax(spins);
+				}
+				else
+				{
+					m_rings.wait(seen, std::memory_order_acquire);
+				}
+			}
+		}
+
+	private:
+		alignas(64) std::atomic<uint32_t> m_rings{ 0 };
+	};
+}
@@ -0,0 +1,42 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+
+#include "Random.h"
+#include <atomic>
+#include <random>
+
+namespace bpn
+{
+	namespace
+	{
+		std::atomic<uint64_t> seed{ 0 };
+	}
+
+	void setRandomSeed(uint64_t value) noexcept
+	{
+		seed.store(value, std::memory_order_relaxed);
+	}
+
+	uint64_t getRandomSeed() noexcept
+	{
+		return seed.load(std::memory_order_relaxed);
+	}
+
+	uint32_t randomSeed(RandomStream stream)
+	{
+		uint64_t const value = getRandomSeed();
+		if (value == 0)
+		{
+			std::random_device rd;
+			return rd();
+		}
+
+		// splitmix64 of the seed and the stream, so that the streams differ
+		uint64_t z = value * 0x9E3779B97F4A7C15ull + static_cast<uint64_t>(stream);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return static_cast<uint32_t>(z ^ (z >> 31));
+	}
+}
@@ -0,0 +1,35 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+// Seeds of the pseudo-random generators : the weight initialization, the
+// shuffling of the data, the sampling of the sweeps, of the replay buffer
+// and of the importance sampling. With a seed set, a run can be reproduced
+// bit for bit.
+
+#pragma once
+
+#include <cstdint>
+
+namespace bpn
+{
+	// Generators seeded by ``randomSeed``, each with its own sequence
+	enum class RandomStream : uint64_t
+	{
+		weights = 1,
+		shuffle,
+		sweep,
+		replay,
+		importance,
+	};
+
+	/**
+	 * Seed from which every generator is seeded, 0 (the default) for a
+	 * different random seed at every call of ``randomSeed``.
+	 */
+	void setRandomSeed(uint64_t seed) noexcept;
+	uint64_t getRandomSeed() noexcept;
+
+	// Seed of a generator of ``stream``
+	uint32_t randomSeed(RandomStream stream);
+}
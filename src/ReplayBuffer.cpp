@@ -0,0 +1,100 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+
+#include "ReplayBuffer.h"
+#include "AtomicFile.h"
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+
+namespace bpn
+{
+	namespace
+	{
+		constexpr char replayMagic[8] = { 'B', 'P', 'N', 'R', 'E', 'P', 'L', 'Y' };
+		constexpr uint32_t replayVersion = 1;
+	}
+
+	bool ReplayBuffer::load(std::string const& path)
+	{
+		std::ifstream file(path, std::ios::in | std::ios::binary);
+		Header header{};
+		if (!file.read((char*)&header, sizeof(header)))
+		{
+			return false;
+		}
+		if (std::memcmp(header.magic, replayMagic, sizeof(replayMagic)) != 0 || header.version != replayVersion
+			|| header.numInputs != m_numInputs || header.numOutputs != m_numOutputs)
+		{
+			throw std::runtime_error(std::format("`{}` is not a replay buffer of {} inputs and {} outputs",
+				path, m_numInputs, m_numOutputs));
+		}
+
+		// Inputs of every entry, then their expected outputs
+		std::size_t const numEntries = std::min<std::size_t>(header.numEntries, m_capacity);
+		m_entries.assign(numEntries, TrainingEntry{ std::vector<double>(m_numInputs), std::vector<int32_t>(m_numOutputs) });
+		file.seekg(sizeof(header));
+		for (TrainingEntry& entry : m_entries)
+		{
+			file.read((char*)entry.m_inputs.data(), m_numInputs * sizeof(double));
+		}
+		file.seekg(sizeof(header) + header.numEntries * m_numInputs * sizeof(double));
+		for (TrainingEntry& entry : m_entries)
+		{
+			file.read((char*)entry.m_expectedOutputs.data(), m_numOutputs * sizeof(int32_t));
+		}
+		if (!file)
+		{
+			throw std::runtime_error(std::format("Truncated replay buffer `{}`", path));
+		}
+		m_seen = std::max<uint64_t>(header.seen, numEntries);
+		return true;
+	}
+
+	void ReplayBuffer::save(std::string const& path) const
+	{
+		Header header{};
+		std::memcpy(header.magic, replayMagic, sizeof(replayMagic));
+		header.version = replayVersion;
+		header.numInputs = m_numInputs;
+		header.numOutputs = m_numOutputs;
+		header.numEntries = m_entries.size();
+		header.seen = m_seen;
+
+		// An interrupted run keeps the previous buffer
+		writeFileAtomically(path, [&](std::ostream& file)
+		{
+			file.write((const char*)&header, sizeof(header));
+			for (TrainingEntry const& entry : m_entries)
+			{
+				file.write((const char*)entry.m_inputs.data(), m_numInputs * sizeof(double));
+			}
+			for (TrainingEntry const& entry : m_entries)
+			{
+				file.write((const char*)entry.m_expectedOutputs.data(), m_numOutputs * sizeof(int32_t));
+			}
+		});
+	}
+
+	void ReplayBuffer::add(std::span<const TrainingEntry> entries, std::mt19937_64& rng)
+	{
+		for (TrainingEntry const& entry : entries)
+		{
+			++m_seen;
+			if (m_entries.size() < m_capacity)
+			{
+				m_entries.push_back(entry);
+				continue;
+			}
+			std::uniform_int_distribution<uint64_t> distribution(0, m_seen - 1);
+			if (uint64_t const slot = distribution(rng); slot < m_capacity)
+			{
+				m_entries[slot] = entry;
+			}
+		}
+	}
+}
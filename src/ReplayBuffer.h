@@ -0,0 +1,72 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+// Replay buffer of incremental training : a bounded, uniform sample of all
+// the training entries seen by the previous trainings, kept in a file and
+// mixed with the new data so that the network does not forget the old one.
+
+#pragma once
+
+#include "NeuralNetworkTrainer.h"
+#include <cstdint>
+#include <random>
+#include <span>
+#include <string>
+
+namespace bpn
+{
+	class ReplayBuffer
+	{
+	public:
+		ReplayBuffer(std::size_t capacity, int32_t numInputs, int32_t numOutputs)
+			: m_capacity{ capacity }
+			, m_numInputs{ numInputs }
+			, m_numOutputs{ numOutputs }
+		{ }
+
+		/**
+		 * Reads the buffer saved at ``path``, if any, and returns whether it
+		 * was read. Throws if it was saved for other numbers of inputs and
+		 * outputs. A buffer larger than the capacity is truncated.
+		 */
+		bool load(std::string const& path);
+		// Throws if the buffer cannot be written, keeping the previous one
+		void save(std::string const& path) const;
+
+		/**
+		 * Reservoir sampling : after ``add``, every entry seen so far is in
+		 * the buffer with the same probability, capacity / seen.
+		 */
+		void add(std::span<const TrainingEntry> entries, std::mt19937_64& rng);
+
+		inline TrainingSet const& entries() const
+		{
+			return m_entries;
+		}
+
+		// Entries added since the buffer was created, by all the trainings
+		inline uint64_t seen() const
+		{
+			return m_seen;
+		}
+
+	private:
+		struct Header
+		{
+			char     magic[8];
+			uint32_t version;
+			int32_t  numInputs;
+			int32_t  numOutputs;
+			uint32_t reserved;
+			uint64_t numEntries;
+			uint64_t seen;
+		};
+
+		std::size_t m_capacity;
+		int32_t     m_numInputs;
+		int32_t     m_numOutputs;
+		TrainingSet m_entries;
+		uint64_t    m_seen = 0;
+	};
+}
@@ -0,0 +1,88 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+
+#include "SparseMatrix.h"
+#include <algorithm>
+
+namespace bpn
+{
+	SparseMatrix::SparseMatrix(const Matrix& m, int nRows)
+		: nRows{ nRows }, nCols{ m.cols() }
+	{
+		assert(nRows <= m.rows());
+		rowStarts.reserve(nRows + 1);
+		rowStarts.push_back(0);
+		for (int r = 0; r < nRows; ++r)
+		{
+			const double* row = m.data() + r * nCols;
+			for (int c = 0; c < nCols; ++c)
+			{
+				if (row[c] != 0.0)
+				{
+					values.push_back(row[c]);
+					columns.push_back(c);
+				}
+			}
+			rowStarts.push_back(static_cast<int32_t>(values.size()));
+		}
+		values.shrink_to_fit();
+		columns.shrink_to_fit();
+	}
+
+	void SparseMatrix::multiplyAdd(const double* x, double* y) const
+	{
+		for (int r = 0; r < nRows; ++r)
+		{
+			double const xr = x[r];
+			if (xr == 0.0)
+			{
+				continue;
+			}
+			for (int32_t k = rowStarts[r]; k < rowStarts[r + 1]; ++k)
+			{
+				y[columns[k]] += xr * values[k];
+			}
+		}
+	}
+
+	void SparseMatrix::multiplyAddRows(std::span<const int32_t> rows, const double* x, double* y) const
+	{
+		for (int32_t r : rows)
+		{
+			double const xr = x[r];
+			for (int32_t k = rowStarts[r]; k < rowStarts[r + 1]; ++k)
+			{
+				y[columns[k]] += xr * values[k];
+			}
+		}
+	}
+
+	void SparseMatrix::multiplyAdd(const Matrix& X, Matrix& Y) const
+	{
+		assert(X.cols() >= nRows && Y.cols() == nCols && X.rows() == Y.rows());
+
+		// Rows of X are processed by blocks so that every non-zero element is
+		// loaded once per block instead of once per row of X.
+		constexpr int blockSize = 8;
+		int const xCols = X.cols();
+		for (int b0 = 0; b0 < X.rows(); b0 += blockSize)
+		{
+			int const b1 = std::min(b0 + blockSize, X.rows());
+			for (int r = 0; r < nRows; ++r)
+			{
+				for (int32_t k = rowStarts[r]; k < rowStarts[r + 1]; ++k)
+				{
+					double const v = values[k];
+					double* y = Y.data() + b0 * nCols + columns[k];
+					const double* x = X.data() + b0 * xCols + r;
+					for (int b = b0; b < b1; ++b, y += nCols, x += xCols)
+					{
+						*y += *x * v;
+					}
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,77 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+// Compressed sparse row (CSR) storage of a pruned weight matrix.
+
+#pragma once
+
+#include "Matrix.h"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace bpn
+{
+	class SparseMatrix
+	{
+	public:
+		/**
+		 * Compresses the first ``nRows`` rows of ``m``, keeping only the
+		 * non-zero elements.
+		 */
+		SparseMatrix(const Matrix& m, int nRows);
+
+		/**
+		 * y[c] += sum_r x[r] * M(r, c)
+		 *
+		 * Rows for which x[r] is 0 are skipped.
+		 */
+		void multiplyAdd(const double* x, double* y) const;
+
+		/**
+		 * Same as multiplyAdd, restricted to the rows listed in ``rows``.
+		 */
+		void multiplyAddRows(std::span<const int32_t> rows, const double* x, double* y) const;
+
+		/**
+		 * Y(b, c) += sum_r X(b, r) * M(r, c) for every row b of X.
+		 */
+		void multiplyAdd(const Matrix& X, Matrix& Y) const;
+
+		[[nodiscard]] int rows() const noexcept
+		{
+			return nRows;
+		}
+
+		[[nodiscard]] int cols() const noexcept
+		{
+			return nCols;
+		}
+
+		[[nodiscard]] std::size_t nonZeros() const noexcept
+		{
+			return values.size();
+		}
+
+		[[nodiscard]] double sparsity() const noexcept
+		{
+			return 1.0 - static_cast<double>(values.size()) / (static_cast<double>(nRows) * nCols);
+		}
+
+		[[nodiscard]] std::size_t byteSize() const noexcept
+		{
+			return values.capacity() * sizeof(double)
+				+ columns.capacity() * sizeof(int32_t)
+				+ rowStarts.capacity() * sizeof(int32_t);
+		}
+
+	private:
+		int nRows;
+		int nCols;
+		std::vector<double>  values;    // non-zero elements, row by row
+		std::vector<int32_t> columns;   // column of each element of ``values``
+		std::vector<int32_t> rowStarts; // row r is [rowStarts[r], rowStarts[r+1]) in ``values``
+	};
+}
@@ -0,0 +1,363 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+
+#include "Sweep.h"
+#include "Random.h"
+#include "vectorstream.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <charconv>
+#include <cmath>
+#include <exception>
+#include <format>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+
+namespace bpn
+{
+	SweepSpace SweepSpace::load(const std::string& path)
+	{
+		std::ifstream file(path);
+		if (!file.good())
+		{
+			throw std::runtime_error(std::format("Error opening sweep file `{}`", path));
+		}
+
+		SweepSpace space;
+		std::string line;
+		while (std::getline(file, line))
+		{
+			if (!line.empty() && line.back() == '\r')
+			{
+				line.pop_back();
+			}
+			if (line.empty() || line.starts_with('#'))
+			{
+				continue;
+			}
+
+			std::size_t const equal = line.find('=');
+			if (equal == std::string::npos || equal == 0 || equal + 1 == line.size())
+			{
+				throw std::runtime_error(std::format("Invalid sweep parameter `{}`", line));
+			}
+
+			Dimension dimension;
+			dimension.name = line.substr(0, equal);
+			std::string_view const values = std::string_view(line).substr(equal + 1);
+
+			// uniform(low,high) or logUniform(low,high)
+			bool const uniform = values.starts_with("uniform(");
+			if (uniform || values.starts_with("logUniform("))
+			{
+				const char* it = values.data() + values.find('(') + 1;
+				const char* const end = values.data() + values.size();
+				auto [comma, ec1] = std::from_chars(it, end, dimension.low);
+				auto [close, ec2] = ec1 == std::errc() && comma < end && *comma == ','
+					? std::from_chars(comma + 1, end, dimension.high)
+					: std::from_chars_result{ comma, std::errc::invalid_argument };
+				dimension.logScale = !uniform;
+				if (ec2 != std::errc() || close + 1 != end || *close != ')' || dimension.high < dimension.low
+					|| (dimension.logScale && dimension.low <= 0.0))
+				{
+					throw std::runtime_error(std::format("Invalid sweep range `{}`", line));
+				}
+			}
+			else
+			{
+				for (std::size_t begin = 0; begin <= values.size();)
+				{
+					std::size_t const end = std::min(values.find('|', begin), values.size());
+					dimension.choices.emplace_back(values.substr(begin, end - begin));
+					begin = end + 1;
+				}
+			}
+			space.m_dimensions.push_back(std::move(dimension));
+		}
+		return space;
+	}
+
+	std::vector<SweepSpace::Parameters> SweepSpace::grid() const
+	{
+		std::vector<Parameters> combinations(1);
+		for (const Dimension& dimension : m_dimensions)
+		{
+			if (dimension.choices.empty())
+			{
+				throw std::runtime_error(std::format("Sweep parameter `{}` is a range, use random search", dimension.name));
+			}
+
+			std::vector<Parameters> extended;
+			extended.reserve(combinations.size() * dimension.choices.size());
+			for (const Parameters& combination : combinations)
+			{
+				for (const std::string& choice : dimension.choices)
+				{
+					extended.push_back(combination);
+					extended.back().emplace_back(dimension.name, choice);
+				}
+			}
+			combinations = std::move(extended);
+		}
+		return combinations;
+	}
+
+	std::vector<SweepSpace::Parameters> SweepSpace::sample(std::size_t count) const
+	{
+		std::mt19937 generator(randomSeed(RandomStream::sweep));
+
+		std::vector<Parameters> samples(count);
+		for (Parameters& parameters : samples)
+		{
+			for (const Dimension& dimension : m_dimensions)
+			{
+				if (!dimension.choices.empty())
+				{
+					std::uniform_int_distribution<std::size_t> distribution(0, dimension.choices.size() - 1);
+					parameters.emplace_back(dimension.name, dimension.choices[distribution(generator)]);
+					continue;
+				}
+
+				double value = 0.0;
+				if (dimension.logScale)
+				{
+					std::uniform_real_distribution<double> distribution(std::log(dimension.low), std::log(dimension.high));
+					value = std::exp(distribution(generator));
+				}
+				else
+				{
+					std::uniform_real_distribution<double> distribution(dimension.low, dimension.high);
+					value = distribution(generator);
+				}
+				parameters.emplace_back(dimension.name, std::format("{:.6g}", value));
+			}
+		}
+		return samples;
+	}
+
+	//-------------------------------------------------------------------------
+
+	Sweep::Sweep(Settings const& settings, std::vector<SweepSpace::Parameters> const& trials)
+		: m_settings(settings)
+	{
+		// Every network reads the same data
+		std::vector<int> dataLayerSizes;
+		std::stringstream dataLayers(settings.m_layers);
+		dataLayers >> dataLayerSizes;
+
+		// The augmentation threads of a trial come on top of the threads running
+		// the trials : the concurrent trials share the cores
+		std::size_t const concurrentTrials = std::clamp<std::size_t>(settings.m_numThreads, 1, std::max<std::size_t>(trials.size(), 1));
+		std::size_t const numCores = std::max(std::thread::hardware_concurrency(), 1u);
+		int32_t const maxAugmentationThreads = static_cast<int32_t>(std::max<std::size_t>(numCores / concurrentTrials, 2) - 1);
+
+		m_trials.reserve(trials.size());
+		for (SweepSpace::Parameters const& parameters : trials)
+		{
+			NetworkTrainer::Settings trainerSettings = settings.m_trainer;
+			trainerSettings.m_verbosity = 0;
+			trainerSettings.m_pipelineStages = 1; // the trials already run concurrently
+			trainerSettings.m_augmentationThreads = std::min(trainerSettings.m_augmentationThreads, maxAugmentationThreads);
+			std::string layers = settings.m_layers;
+			std::string activation = settings.m_activation;
+
+			for (auto const& [name, value] : parameters)
+			{
+				auto toNumber = [&](auto& number)
+				{
+					auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), number);
+					if (ec != std::errc() || end != value.data() + value.size())
+					{
+						throw std::runtime_error(std::format("Invalid value `{}` for sweep parameter `{}`", value, name));
+					}
+				};
+
+				if (name == "layers") { layers = value; }
+				else if (name == "activation") { activation = value; }
+				else if (name == "learningRate") { toNumber(trainerSettings.m_learningRate); }
+				else if (name == "momentum") { toNumber(trainerSettings.m_momentum); }
+				else if (name == "optimizer") { trainerSettings.m_optimizer = value; }
+				else if (name == "loss") { trainerSettings.m_loss = value; }
+				else if (name == "learningRateSchedule") { trainerSettings.m_learningRateSchedule = value; }
+				else if (name == "miniBatchSize") { toNumber(trainerSettings.m_miniBatchSize); }
+				else
+				{
+					throw std::runtime_error(std::format("Unknown sweep parameter `{}`", name));
+				}
+			}
+
+			std::vector<int> layerSizes;
+			std::stringstream ss(layers);
+			ss >> layerSizes;
+			if (layerSizes.size() < 2 || layerSizes.front() != dataLayerSizes.front()
+				|| layerSizes.back() != dataLayerSizes.back())
+			{
+				throw std::runtime_error(std::format("Sweep layers `{}` do not match the inputs and outputs of `{}`",
+					layers, settings.m_layers));
+			}
+
+			Trial& trial = m_trials.emplace_back();
+			trial.id = static_cast<int32_t>(m_trials.size()) - 1;
+			trial.parameters = parameters;
+			trial.network = std::make_unique<Network>(layerSizes,
+				ActivationFunction::deserializeList(activation, layerSizes.size() - 1),
+				settings.m_labels);
+			trial.trainer = std::make_unique<NetworkTrainer>(trainerSettings, trial.network.get());
+		}
+	}
+
+	template<typename F>
+	void Sweep::ForEachTrial(std::vector<Trial*> const& trials, F f)
+	{
+		// The workers claim the trials one by one. The first exception stops
+		// the claims, and is rethrown here once every worker is done.
+		std::atomic<std::size_t> next{ 0 };
+		std::exception_ptr error;
+		std::mutex errorMutex;
+		auto work = [&]()
+		{
+			try
+			{
+				for (std::size_t i = next++; i < trials.size(); i = next++)
+				{
+					f(*trials[i]);
+				}
+			}
+			catch (...)
+			{
+				std::lock_guard lock(errorMutex);
+				if (!error)
+				{
+					error = std::current_exception();
+				}
+				next = trials.size();
+			}
+		};
+
+		std::size_t const numThreads = std::min<std::size_t>(std::max(m_settings.m_numThreads, 1), trials.size());
+		std::vector<std::thread> workers;
+		for (std::size_t t = 1; t < numThreads; ++t)
+		{
+			workers.emplace_back(work);
+		}
+		work();
+		for (std::thread& worker : workers)
+		{
+			worker.join();
+		}
+		if (error)
+		{
+			std::rethrow_exception(error);
+		}
+	}
+
+	bool Sweep::isBetter(Trial const& a, Trial const& b)
+	{
+		if (a.rungs != b.rungs)
+		{
+			return a.rungs > b.rungs;
+		}
+		if (a.generalizationAccuracy != b.generalizationAccuracy)
+		{
+			return a.generalizationAccuracy > b.generalizationAccuracy;
+		}
+		return a.generalizationMSE < b.generalizationMSE;
+	}
+
+	void Sweep::Run(TrainingData const& trainingData)
+	{
+		std::vector<Trial*> remaining;
+		for (Trial& trial : m_trials)
+		{
+			trial.trainer->BeginTraining();
+			remaining.push_back(&trial);
+		}
+
+		uint64_t const maxEpochs = m_settings.m_trainer.m_maxEpochs;
+		uint64_t budget = std::min(std::max<uint64_t>(m_settings.m_minEpochs, 1), maxEpochs);
+		for (int32_t rung = 0; !remaining.empty(); ++rung)
+		{
+			if (m_settings.m_trainer.m_verbosity >= 1)
+			{
+				std::cout << "Rung " << rung << ": " << remaining.size() << " trials, "
+					<< budget << " epochs" << std::endl;
+			}
+
+			ForEachTrial(remaining, [&](Trial& trial)
+			{
+				trial.trainer->TrainEpochs(trainingData, budget - std::min(budget, trial.trainer->getCurrentEpoch()));
+				trial.rungs = rung + 1;
+				trial.epochs = trial.trainer->getCurrentEpoch();
+				trial.generalizationAccuracy = trial.trainer->getGeneralizationSetAccuracy();
+				trial.generalizationMSE = trial.trainer->getGeneralizationSetMSE();
+			});
+
+			std::ranges::sort(remaining, [](const Trial* a, const Trial* b) { return isBetter(*a, *b); });
+			if (budget >= maxEpochs || remaining.size() == 1)
+			{
+				break;
+			}
+
+			// The eliminated trials release their network and trainer
+			auto const kept = static_cast<std::size_t>(std::ceil(remaining.size() / m_settings.m_reductionFactor));
+			for (std::size_t i = std::max<std::size_t>(kept, 1); i < remaining.size(); ++i)
+			{
+				remaining[i]->trainer.reset();
+				remaining[i]->network.reset();
+			}
+			remaining.resize(std::max<std::size_t>(kept, 1));
+			budget = std::min(maxEpochs, static_cast<uint64_t>(std::ceil(budget * m_settings.m_reductionFactor)));
+		}
+
+		ForEachTrial(remaining, [&](Trial& trial)
+		{
+			trial.trainer->EndTraining(trainingData);
+			trial.validationAccuracy = trial.trainer->getValidationSetAccuracy();
+		});
+		m_best = remaining.front();
+	}
+
+	void Sweep::PrintLeaderboard(std::ostream& os) const
+	{
+		std::vector<const Trial*> ranking;
+		for (const Trial& trial : m_trials)
+		{
+			ranking.push_back(&trial);
+		}
+		std::ranges::stable_sort(ranking, [](const Trial* a, const Trial* b) { return isBetter(*a, *b); });
+
+		os << "==========================================================================" << std::endl
+			<< " Sweep leaderboard" << std::endl
+			<< "  Rank  Trial  Epochs  Gen. Acc.  Gen. MSE   Val. Acc.  Parameters" << std::endl;
+		for (std::size_t rank = 0; rank < ranking.size(); ++rank)
+		{
+			const Trial& trial = *ranking[rank];
+			std::string parameters;
+			for (auto const& [name, value] : trial.parameters)
+			{
+				parameters += (parameters.empty() ? "" : ", ") + name + "=" + value;
+			}
+			os << std::format("  {:>4}  {:>5}  {:>6}  {:>8.3f}%  {:>9.6f}  {:>9}  {}",
+				rank + 1, trial.id, trial.epochs, trial.generalizationAccuracy, trial.generalizationMSE,
+				trial.validationAccuracy < 0.0 ? std::string("-") : std::format("{:.3f}%", trial.validationAccuracy),
+				parameters) << std::endl;
+		}
+		os << "==========================================================================" << std::endl;
+	}
+
+	const Network& Sweep::getBestNetwork() const
+	{
+		assert(m_best != nullptr && m_best->network);
+		return *m_best->network;
+	}
+}
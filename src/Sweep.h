@@ -0,0 +1,127 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+// Hyperparameter sweep : many networks are trained concurrently on the
+// same in-memory dataset, the poor ones being dropped early by successive
+// halving.
+
+#pragma once
+
+#include "NeuralNetworkTrainer.h"
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bpn
+{
+	/**
+	 * Search space read from a file of ``name=values`` lines, ``#`` starting
+	 * a comment. The values are either a ``|`` separated list of choices or,
+	 * for random search only, a range of numbers :
+	 *
+	 *     layers=784,64,10|784,128,10
+	 *     activation=Sigmoid(1)|ReLU
+	 *     learningRate=logUniform(0.0001,0.1)
+	 *     momentum=uniform(0.5,0.95)
+	 */
+	class SweepSpace
+	{
+	public:
+		// Value of every swept parameter, in the order of the file
+		typedef std::vector<std::pair<std::string, std::string>> Parameters;
+
+		static SweepSpace load(const std::string& path);
+
+		/**
+		 * Every combination of the choices. Throws if a parameter is a range.
+		 */
+		std::vector<Parameters> grid() const;
+
+		/**
+		 * ``count`` independent random combinations.
+		 */
+		std::vector<Parameters> sample(std::size_t count) const;
+
+	private:
+		struct Dimension
+		{
+			std::string              name;
+			std::vector<std::string> choices;   // empty for a range
+			double                   low = 0.0;
+			double                   high = 0.0;
+			bool                     logScale = false;
+		};
+
+		std::vector<Dimension> m_dimensions;
+	};
+
+	class Sweep
+	{
+	public:
+		struct Settings
+		{
+			NetworkTrainer::Settings m_trainer;      // Settings of the trials before the swept parameters
+			std::string              m_layers;
+			std::string              m_activation;
+			std::string              m_labels;
+			int32_t                  m_numThreads;
+			uint64_t                 m_minEpochs;    // Epochs of the first rung
+			double                   m_reductionFactor; // A rung keeps 1 / m_reductionFactor of the trials
+		};
+
+		/**
+		 * Builds the network and the trainer of every trial. The swept
+		 * parameters can be ``layers``, ``activation``, ``learningRate``,
+		 * ``momentum``, ``optimizer``, ``loss``, ``learningRateSchedule`` and
+		 * ``miniBatchSize``.
+		 */
+		Sweep(Settings const& settings, std::vector<SweepSpace::Parameters> const& trials);
+
+		/**
+		 * Successive halving : every remaining trial is trained up to the
+		 * epoch budget of the rung, then only the best trials by generalization
+		 * set accuracy are kept and the budget grows by the reduction factor,
+		 * until one trial is left or the maximum number of epochs is reached.
+		 * Trials run concurrently on ``m_numThreads`` threads.
+		 */
+		void Run(TrainingData const& trainingData);
+
+		/**
+		 * Trials ranked by the last rung they reached, then by generalization
+		 * set accuracy.
+		 */
+		void PrintLeaderboard(std::ostream& os) const;
+
+		// Best network once ``Run`` returned
+		const Network& getBestNetwork() const;
+
+	private:
+		struct Trial
+		{
+			int32_t                         id;
+			SweepSpace::Parameters          parameters;
+			std::unique_ptr<Network>        network;
+			std::unique_ptr<NetworkTrainer> trainer;
+			int32_t                         rungs = 0;      // Rungs completed
+			uint64_t                        epochs = 0;
+			double                          generalizationAccuracy = 0.0;
+			double                          generalizationMSE = 0.0;
+			double                          validationAccuracy = -1.0; // Finalists only
+		};
+
+		// Calls ``f`` on every trial of ``trials``, on the worker threads
+		template<typename F>
+		void ForEachTrial(std::vector<Trial*> const& trials, F f);
+
+		// Ranking order : true if ``a`` is better than ``b``
+		static bool isBetter(Trial const& a, Trial const& b);
+
+		Settings           m_settings;
+		std::vector<Trial> m_trials;
+		const Trial*       m_best = nullptr;
+	};
+}
@@ -0,0 +1,106 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+
+#include "ThreadPool.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+namespace bpn
+{
+	void cpuRelax(uint32_t spins)
+	{
+		if (spins >= 1024)
+		{
+			std::this_thread::yield();
+			return;
+		}
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+		_mm_pause();
+#elif defined(__aarch64__)
+		asm volatile("yield");
+#endif
+	}
+
+	ThreadPool::ThreadPool(int32_t numThreads)
+	{
+		for (int32_t part = 1; part < numThreads; ++part)
+		{
+			m_workers.emplace_back(&ThreadPool::work, this, part);
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		m_stop = true;
+		m_generation.fetch_add(1);
+		m_generation.notify_all();
+		for (std::thread& worker : m_workers)
+		{
+			worker.join();
+		}
+	}
+
+	void ThreadPool::dispatch(Function function, void* context)
+	{
+		if (m_workers.empty())
+		{
+			function(context, 0);
+			return;
+		}
+
+		// The previous task is over (m_pending is 0), no worker reads these
+		m_function = function;
+		m_context = context;
+		m_pending.store(size() - 1, std::memory_order_relaxed);
+
+		// Sequentially consistent with the worker side : either a worker sees
+		// the new generation before sleeping, or it is counted in m_sleeping
+		m_generation.fetch_add(1);
+		if (m_sleeping.load() > 0)
+		{
+			m_generation.notify_all();
+		}
+
+		function(context, 0);
+		for (uint32_t spins = 0; m_pending.load(std::memory_order_acquire) != 0; ++spins)
+		{
+			cpuRelax(spins);
+		}
+	}
+
+	void ThreadPool::work(int32_t part)
+	{
+		uint32_t seen = 0;
+		for (;;)
+		{
+			uint32_t generation;
+			uint32_t spins = 0;
+			while ((generation = m_generation.load(std::memory_order_acquire)) == seen)
+			{
+				if (++spins < SpinIterations)
+				{
+					cpuRelax(spins);
+				}
+				else
+				{
+					m_sleeping.fetch_add(1);
+					m_generation.wait(seen);
+					m_sleeping.fetch_sub(1);
+					spins = 0;
+				}
+			}
+			seen = generation;
+
+			if (m_stop)
+			{
+				return;
+			}
+			m_function(m_context, part);
+			m_pending.fetch_sub(1, std::memory_order_release);
+		}
+	}
+}
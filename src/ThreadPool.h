@@ -0,0 +1,71 @@
+//-------------------------------------------------------------------------
+// Simple back-propagation neural network example
+// MIT license: https://opensource.org/licenses/MIT
+//-------------------------------------------------------------------------
+// Persistent pool of worker threads for fine grained parallel loops, like
+// the neurons of one layer in a single evaluation. Work is handed over
+// through atomics, and idle workers spin for a while before sleeping, so
+// that a loop of a few microseconds does not pay for a thread wake up.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace bpn
+{
+	/**
+	 * Body of a spin loop, ``spins`` being the number of iterations so far :
+	 * hints the processor that the thread is spinning, and after a while
+	 * yields to the system in case the thread waited for is not running.
+	 */
+	void cpuRelax(uint32_t spins);
+
+	class ThreadPool
+	{
+		// Iterations an idle worker spins for, pausing and then yielding,
+		// before waiting on a futex
+		static constexpr uint32_t SpinIterations = 1u << 15;
+
+	public:
+		// ``numThreads`` includes the thread calling ``run``
+		explicit ThreadPool(int32_t numThreads);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		inline int32_t size() const
+		{
+			return static_cast<int32_t>(m_workers.size()) + 1;
+		}
+
+		/**
+		 * Calls ``task(part)`` for every part in [0, size()), part 0 on the
+		 * calling thread, and returns once every call returned. ``task``
+		 * must not throw. Only one thread may call ``run`` at a time.
+		 */
+		template<typename F>
+		void run(F& task)
+		{
+			dispatch([](void* context, int32_t part) { (*static_cast<F*>(context))(part); }, &task);
+		}
+
+	private:
+		using Function = void (*)(void* context, int32_t part);
+
+		void dispatch(Function function, void* context);
+		void work(int32_t part);
+
+		std::vector<std::thread>    m_workers;       // worker k runs part k + 1
+		Function                    m_function = nullptr;
+		void*                       m_context = nullptr;
+		bool                        m_stop = false;
+		// Incremented when a task is published, workers wait on its value
+		alignas(64) std::atomic<uint32_t> m_generation{ 0 };
+		alignas(64) std::atomic<int32_t>  m_pending{ 0 };   // parts still running on workers
+		alignas(64) std::atomic<int32_t>  m_sleeping{ 0 };  // workers blocked in m_generation.wait
+	};
+}
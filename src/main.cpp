@@ -16,17 +16,31 @@
 #include <sstream>
 #include <fstream>
 #include <assert.h>
+#include <algorithm>
+#include <exception>
+#include <filesystem>
+#include <random>
+#include <thread>
 
 #include "NeuralNetworkTrainer.h"
+#include "AutoTuner.h"
+#include "DataParallel.h"
+#include "Sweep.h"
+#include "CodeGenerator.h"
 #include "DataReader.h"
 #include "Matrix.h"
+#include "MemoryTracker.h"
+#include "Random.h"
+#include "ReplayBuffer.h"
 #include "vectorstream.h"
 
 // Operators from "vectorstream.h"
 using bpn::operator<<;
 using bpn::operator>>;
 
+// Errors of the settings and of the files are reported as the other errors
 int main()
+try
 {
 	StopWatcher::init("delete_this_to_stop.txt");
 
@@ -41,21 +55,143 @@ int main()
 	std::string trainingDataPath(configParser.get<std::string>("datafile"));
 	std::string layers(configParser.get<std::string>("layers"));
 	std::string exportFile(configParser.get<std::string>("export"));
+	std::string exportHeader(configParser.get<std::string>("exportHeader", "none"));
 	std::string activationFunction(configParser.get<std::string>("activation"));
 	std::string labels(configParser.get<std::string>("labels"));
 	std::uint64_t maxEpoch(configParser.get<std::uint64_t>("maxEpoch"));
 	double learningRate{ configParser.get<double>("learningRate") };
 	double momentum{ configParser.get<double>("momentum") };
+	std::string learningRateSchedule(configParser.get<std::string>("learningRateSchedule", "constant"));
+	std::uint64_t warmupEpochs{ configParser.get<std::uint64_t>("warmupEpochs", 0) };
+	std::uint64_t patience{ configParser.get<std::uint64_t>("patience", 0) };
 	bool batchLearning{ configParser.get<bool>("batchLearning") };
+	std::uint64_t miniBatchSize{ configParser.get<std::uint64_t>("miniBatchSize", 0) };
+	std::int32_t processes{ configParser.get<std::int32_t>("processes", 1) };
+	bool scalingReport{ configParser.get<bool>("scalingReport", false) };
+	std::int32_t pipelineStages{ configParser.get<std::int32_t>("pipelineStages", 1) };
+	std::int32_t pipelineMicroBatch{ configParser.get<std::int32_t>("pipelineMicroBatch", 8) };
+	std::string pipelineSchedule(configParser.get<std::string>("pipelineSchedule", "1F1B"));
+	std::string sweepFile(configParser.get<std::string>("sweep", "none"));
+	std::uint64_t sweepTrials{ configParser.get<std::uint64_t>("sweepTrials", 0) };
+	std::int32_t sweepThreads{ configParser.get<std::int32_t>("sweepThreads", 0) };
+	std::uint64_t sweepMinEpochs{ configParser.get<std::uint64_t>("sweepMinEpochs", 1) };
+	double sweepReductionFactor{ configParser.get<double>("sweepReductionFactor", 3.0) };
+	std::int32_t intraLayerThreads{ configParser.get<std::int32_t>("intraLayerThreads", 1) };
+	std::uint64_t intraLayerMinWeights{ configParser.get<std::uint64_t>("intraLayerMinWeights",
+		bpn::Network::DefaultParallelLayerWeights) };
+	bool autoTune{ configParser.get<bool>("autoTune", false) };
+	std::string tuningCache(configParser.get<std::string>("tuningCache", "bpn_tuning.txt"));
+	std::string optimizer(configParser.get<std::string>("optimizer", "SGD"));
+	std::string loss(configParser.get<std::string>("loss", "MSE"));
+	std::string augmentation(configParser.get<std::string>("augmentation", "none"));
+	std::int32_t augmentationThreads{ configParser.get<std::int32_t>("augmentationThreads", 0) };
 	double accuracy{ configParser.get<double>("accuracy") };
 	std::uint16_t verbosity{ configParser.get<std::uint16_t>("verbosity") };
+	double pruneThreshold{ configParser.get<double>("pruneThreshold", 0.0) };
+	double pruneSparsity{ configParser.get<double>("pruneSparsity", 0.0) };
+	std::uint64_t pruneRetrainEpochs{ configParser.get<std::uint64_t>("pruneRetrainEpochs", 0) };
+	bool hugePages{ configParser.get<bool>("hugePages", false) };
+	std::uint64_t seed{ configParser.get<std::uint64_t>("seed", 0) };
+	bool deterministicReduction{ configParser.get<bool>("deterministicReduction", false) };
+	std::int32_t freezeLayers{ configParser.get<std::int32_t>("freezeLayers", 0) };
+	double importanceSampling{ configParser.get<double>("importanceSampling", 0.0) };
+	std::size_t memoryBudget{ bpn::MemoryTracker::parseBytes(configParser.get<std::string>("memoryBudget", "")) };
 
-	bpn::DataReader::Format inputDataFormat{ bpn::DataReader::Format::binary };
+	bpn::DataReader::Format inputDataFormat{ bpn::DataReader::parseFormat(configParser.get<std::string>("dataFormat", "binary")) };
+	bool dataCache{ configParser.get<bool>("dataCache", true) };
+	std::string initialModel(configParser.get<std::string>("initialModel", "none"));
+	std::string optimizerState(configParser.get<std::string>("optimizerState", "none"));
+	bool resumeSchedule{ configParser.get<bool>("resumeSchedule", false) };
+	std::string replayBuffer(configParser.get<std::string>("replayBuffer", "none"));
+	std::uint64_t replaySize{ configParser.get<std::uint64_t>("replaySize", 0) };
+	std::string teacherModel(configParser.get<std::string>("teacherModel", "none"));
+	double teacherWeight{ configParser.get<double>("teacherWeight", 0.5) };
+
+	bpn::Arena::setUseHugePages(hugePages);
+	bpn::setRandomSeed(seed);
+
+	if (processes < 1 || (processes > 1 && !batchLearning))
+	{
+		std::println(std::cerr, "Error: data parallel training needs processes >= 1 and batchLearning=1");
+		return 1;
+	}
+	if (scalingReport && !batchLearning)
+	{
+		std::println(std::cerr, "Error: the scaling report needs batchLearning=1");
+		return 1;
+	}
+	if (pipelineStages < 1 || (pipelineStages > 1 && (!batchLearning || processes > 1)))
+	{
+		std::println(std::cerr, "Error: pipeline parallel training needs pipelineStages >= 1, batchLearning=1 and processes=1");
+		return 1;
+	}
+	if (freezeLayers < 0 || (freezeLayers > 0 && pipelineStages > 1))
+	{
+		std::println(std::cerr, "Error: frozen layers need freezeLayers >= 0 and pipelineStages=1");
+		return 1;
+	}
+	if (importanceSampling < 0.0 || (importanceSampling > 0.0 && (pipelineStages > 1 || augmentation != "none")))
+	{
+		std::println(std::cerr, "Error: importance sampling needs importanceSampling >= 0, pipelineStages=1 and augmentation=none");
+		return 1;
+	}
+	if (teacherModel != "none" && (teacherWeight < 0.0 || teacherWeight > 1.0 || pipelineStages > 1 || augmentation != "none"))
+	{
+		std::println(std::cerr, "Error: distillation needs 0 <= teacherWeight <= 1, pipelineStages=1 and augmentation=none");
+		return 1;
+	}
+
+	// Incremental training starts from an exported network, whose layers,
+	// activation functions and labels replace those of this file
+	std::ifstream initialModelStream;
+	if (initialModel != "none")
+	{
+		initialModelStream.open(initialModel);
+		if (!initialModelStream.is_open())
+		{
+			std::println(std::cerr, "Error: unable to read the initial model `{}`", initialModel);
+			return 1;
+		}
+	}
 
 	std::vector<int> layerSizes;
 	std::stringstream ss(layers);
 	ss >> layerSizes;
-	bpn::Network nn(layerSizes, bpn::ActivationFunction::deserialize(activationFunction), labels);
+	bpn::Network nn = initialModelStream.is_open() ? bpn::Network(initialModelStream)
+		: bpn::Network(layerSizes,
+			bpn::ActivationFunction::deserializeList(activationFunction, layerSizes.size() - 1),
+			labels);
+	layerSizes = nn.getLayerSizes();
+	if (initialModelStream.is_open() && verbosity >= 1)
+	{
+		std::cout << "Training from the model `" << initialModel << "`: " << nn.getLayerSizes()
+			<< ", " << nn.activationFunctionName() << std::endl;
+	}
+
+	// Distillation trains this network against the outputs of an exported,
+	// usually larger, one
+	std::optional<bpn::Network> teacher;
+	if (teacherModel != "none")
+	{
+		std::ifstream teacherStream(teacherModel);
+		if (!teacherStream.is_open())
+		{
+			std::println(std::cerr, "Error: unable to read the teacher model `{}`", teacherModel);
+			return 1;
+		}
+		teacher.emplace(teacherStream);
+		if (teacher->getNumInputs() != nn.getNumInputs() || teacher->getNumOutputs() != nn.getNumOutputs())
+		{
+			std::println(std::cerr, "Error: the teacher model `{}` has {} inputs and {} outputs instead of {} and {}",
+				teacherModel, teacher->getNumInputs(), teacher->getNumOutputs(), nn.getNumInputs(), nn.getNumOutputs());
+			return 1;
+		}
+		if (verbosity >= 1)
+		{
+			std::cout << "Distilling the model `" << teacherModel << "`: " << teacher->getLayerSizes()
+				<< ", " << teacher->activationFunctionName() << std::endl;
+		}
+	}
 	
 	if (verbosity >= 2)
 	{
@@ -67,6 +203,55 @@ int main()
 		nn.getNumOutputs(),
 		inputDataFormat,
 		verbosity);
+	dataReader.setUseCache(dataCache);
+
+	bpn::NetworkTrainer::Settings trainerSettings;
+	trainerSettings.m_learningRate = learningRate;
+	trainerSettings.m_momentum = momentum;
+	trainerSettings.m_useBatchLearning = batchLearning;
+	trainerSettings.m_miniBatchSize = miniBatchSize;
+	trainerSettings.m_optimizer = optimizer;
+	trainerSettings.m_loss = loss;
+	trainerSettings.m_augmentation = augmentation;
+	trainerSettings.m_augmentationThreads = augmentationThreads > 0 ? augmentationThreads
+		: std::max<std::int32_t>(1, static_cast<std::int32_t>(std::thread::hardware_concurrency()) - 1);
+	trainerSettings.m_pipelineStages = pipelineStages;
+	trainerSettings.m_pipelineMicroBatch = pipelineMicroBatch;
+	trainerSettings.m_pipelineSchedule = pipelineSchedule;
+	trainerSettings.m_deterministicReduction = deterministicReduction;
+	trainerSettings.m_frozenLayers = freezeLayers;
+	trainerSettings.m_importanceSampling = importanceSampling;
+	trainerSettings.m_resumeSchedule = resumeSchedule;
+	trainerSettings.m_learningRateSchedule = learningRateSchedule;
+	trainerSettings.m_warmupEpochs = warmupEpochs;
+	trainerSettings.m_patience = patience;
+	trainerSettings.m_maxEpochs = maxEpoch;
+	trainerSettings.m_desiredAccuracy = accuracy;
+	trainerSettings.m_verbosity = verbosity;
+
+	// The replay entries are held by the buffer and copied in the training set
+	std::size_t const replayEntries = replayBuffer != "none" && sweepFile == "none" ? replaySize : 0;
+	std::size_t const plannedFootprint = dataReader.plannedFootprint()
+		+ 2 * replayEntries * bpn::DataReader::entryFootprint(nn.getNumInputs(), nn.getNumOutputs())
+		+ bpn::Network::plannedFootprint(layerSizes)
+		+ bpn::NetworkTrainer::plannedFootprint(layerSizes, trainerSettings, dataReader.plannedEntries() + replayEntries,
+			teacher.has_value())
+		+ (teacher ? bpn::Network::plannedFootprint(teacher->getLayerSizes()) : 0);
+	if (verbosity >= 1)
+	{
+		std::cout << "Planned memory footprint: " << bpn::MemoryTracker::formatBytes(plannedFootprint);
+		if (memoryBudget > 0)
+		{
+			std::cout << " (budget: " << bpn::MemoryTracker::formatBytes(memoryBudget) << ")";
+		}
+		std::cout << std::endl;
+	}
+	if (memoryBudget > 0 && plannedFootprint > memoryBudget)
+	{
+		std::println(std::cerr, "Error: planned memory footprint of {} exceeds the memory budget of {}",
+			bpn::MemoryTracker::formatBytes(plannedFootprint), bpn::MemoryTracker::formatBytes(memoryBudget));
+		return 1;
+	}
 
 	std::cout << "Reading data from file `" << trainingDataPath << "`" << std::endl;
 	bpn::TrainingData data;
@@ -91,23 +276,238 @@ int main()
 			<< std::endl;
 	}
 
-	bpn::NetworkTrainer::Settings trainerSettings;
-	trainerSettings.m_learningRate = learningRate;
-	trainerSettings.m_momentum = momentum;
-	trainerSettings.m_useBatchLearning = batchLearning;
-	trainerSettings.m_maxEpochs = maxEpoch;
-	trainerSettings.m_desiredAccuracy = accuracy;
-	trainerSettings.m_verbosity = verbosity;
+	// Replay buffer of incremental training : a uniform sample of the
+	// entries of the previous trainings is mixed with the new training set,
+	// and the new entries are sampled into the buffer for the next one.
+	// Sweeps train on the new training set only.
+	std::optional<bpn::ReplayBuffer> replay;
+	if (replayBuffer != "none" && replaySize > 0 && sweepFile == "none")
+	{
+		replay.emplace(replaySize, nn.getNumInputs(), nn.getNumOutputs());
+		replay->load(replayBuffer);
+		std::size_t const numNewEntries = data.m_trainingSet.size();
+		data.m_trainingSet.insert(data.m_trainingSet.end(), replay->entries().begin(), replay->entries().end());
+		std::mt19937_64 rng(bpn::randomSeed(bpn::RandomStream::replay));
+		replay->add({ data.m_trainingSet.data(), numNewEntries }, rng);
+		std::shuffle(data.m_trainingSet.begin(), data.m_trainingSet.end(), rng);
+		data.updateMemory();
+		if (verbosity >= 1)
+		{
+			std::println("Replay buffer: {} previous entries trained with the {} new ones",
+				data.m_trainingSet.size() - numNewEntries, numNewEntries);
+		}
+	}
 
-	bpn::NetworkTrainer trainer(trainerSettings, &nn);
+	// Speed settings measured on this host, or read from the tuning cache.
+	// The threads of the tuning are stopped before the processes are forked.
+	if (autoTune && sweepFile == "none")
+	{
+		std::int32_t const cores = std::max<std::int32_t>(1, static_cast<std::int32_t>(std::thread::hardware_concurrency()));
+		bpn::AutoTuner tuner(tuningCache);
+		bpn::Tuning const tuning = tuner.tune(nn, data.m_trainingSet, trainerSettings,
+			std::max(1, cores / processes), intraLayerMinWeights);
+		nn.setBatchTiling(tuning.batchTiling);
+		// An explicit intraLayerThreads is kept, 1 being the default
+		bool const tunedThreads = intraLayerThreads == 1;
+		if (tunedThreads)
+		{
+			intraLayerThreads = tuning.intraLayerThreads;
+		}
+		trainerSettings.m_pipelineMicroBatch = tuning.pipelineMicroBatch;
+		if (verbosity >= 1)
+		{
+			std::println("Auto-tuning ({} in {:.3f} s): batch tile {} samples x {} columns, {} intra-layer threads, pipeline micro-batch {}",
+				tuner.wasCached() ? "cached" : "measured", tuner.getSeconds(), tuning.batchTiling.samples,
+				tuning.batchTiling.columns, tuning.intraLayerThreads, tuning.pipelineMicroBatch);
+			if (!tunedThreads)
+			{
+				std::println("Auto-tuning: the {} intra-layer threads of the configuration are kept", intraLayerThreads);
+			}
+			if (!tuner.getSaveError().empty())
+			{
+				std::println("Could not write the tuning cache: {}", tuner.getSaveError());
+			}
+		}
+	}
+
+	// Many networks trained concurrently on the data read once
+	if (sweepFile != "none")
+	{
+		bpn::SweepSpace const space = bpn::SweepSpace::load(sweepFile);
+		bpn::Sweep::Settings sweepSettings;
+		sweepSettings.m_trainer = trainerSettings;
+		sweepSettings.m_layers = layers;
+		sweepSettings.m_activation = activationFunction;
+		sweepSettings.m_labels = labels;
+		sweepSettings.m_numThreads = sweepThreads > 0 ? sweepThreads
+			: std::max<std::int32_t>(1, static_cast<std::int32_t>(std::thread::hardware_concurrency()));
+		sweepSettings.m_minEpochs = sweepMinEpochs;
+		sweepSettings.m_reductionFactor = std::max(sweepReductionFactor, 1.5);
 
-	trainer.Train(data);
+		bpn::Sweep sweep(sweepSettings, sweepTrials > 0 ? space.sample(sweepTrials) : space.grid());
+		sweep.Run(data);
+		sweep.PrintLeaderboard(std::cout);
 
-	if (verbosity >= 2)
+		std::ofstream fs(exportFile);
+		fs << sweep.getBestNetwork().serialize() << std::endl;
+
+		if (verbosity >= 1)
+		{
+			std::cout << bpn::MemoryTracker::summary() << std::endl;
+		}
+		return 0;
+	}
+
+	std::size_t const communicationSize = bpn::NetworkTrainer::communicationSize(layerSizes);
+
+	// Throughput of one epoch of training on 1, 2, 4, ... processes, against
+	// pipelines of as many stages
+	if (scalingReport)
 	{
-		std::cout << nn << std::endl;
+		std::int32_t const maxStages = std::min<std::int32_t>(pipelineStages, static_cast<std::int32_t>(layerSizes.size()) - 1);
+		std::int32_t const maxWorkers = std::max(processes, maxStages);
+		auto benchmark = [&](std::int32_t numProcesses, std::int32_t numStages)
+		{
+			return bpn::launchProcesses(numProcesses, communicationSize,
+				[&](bpn::Communicator& communicator)
+				{
+					bpn::NetworkTrainer::Settings settings = trainerSettings;
+					settings.m_verbosity = 0;
+					settings.m_pipelineStages = numStages;
+					bpn::NetworkTrainer trainer(settings, &nn);
+					bpn::keepShard(data.m_trainingSet, communicator.rank(), communicator.size());
+					if (numStages == 1)
+					{
+						trainer.setCommunicator(&communicator);
+					}
+					double const throughput = trainer.Benchmark(data.m_trainingSet, 1);
+					if (communicator.rank() == 0)
+					{
+						communicator.setResult(throughput);
+					}
+					return 0;
+				});
+		};
+
+		std::cout << std::endl << "Scaling report (samples per second for one epoch)" << std::endl;
+		double singleProcessThroughput = 0.0;
+		for (std::int32_t p = 1; ; p = std::min(2 * p, maxWorkers))
+		{
+			bpn::LaunchResult const result = benchmark(p, 1);
+			if (result.exitCode != 0)
+			{
+				return result.exitCode;
+			}
+			if (p == 1)
+			{
+				singleProcessThroughput = result.result;
+			}
+			std::println(" {:>3} processes: {:>12.1f} samples/s, efficiency: {:.1f}%",
+				p, result.result, 100.0 * result.result / (p * singleProcessThroughput));
+			if (p > 1 && p <= maxStages)
+			{
+				bpn::LaunchResult const pipelineResult = benchmark(1, p);
+				if (pipelineResult.exitCode != 0)
+				{
+					return pipelineResult.exitCode;
+				}
+				std::println(" {:>3} stages:    {:>12.1f} samples/s, efficiency: {:.1f}%",
+					p, pipelineResult.result, 100.0 * pipelineResult.result / (p * singleProcessThroughput));
+			}
+			if (p == maxWorkers)
+			{
+				break;
+			}
+		}
 	}
 
-	std::ofstream fs(exportFile);
-	fs << nn.serialize() << std::endl;
-}
\ No newline at end of file
+	// Training, pruning and export, on rank 0 only when data parallel
+	auto train = [&](bpn::Communicator* pCommunicator)
+	{
+		bool const mainProcess = pCommunicator == nullptr || pCommunicator->rank() == 0;
+		bpn::NetworkTrainer::Settings settings = trainerSettings;
+		settings.m_verbosity = mainProcess ? verbosity : 0;
+		// Threads are started here since they do not survive the fork of the
+		// data parallel processes
+		nn.setIntraLayerThreads(intraLayerThreads > 0 ? intraLayerThreads
+			: static_cast<std::int32_t>(std::thread::hardware_concurrency()), intraLayerMinWeights);
+		if (teacher)
+		{
+			// Same threads as the student, for the inference speed comparison
+			teacher->setIntraLayerThreads(nn.getIntraLayerThreads(), intraLayerMinWeights);
+		}
+		bpn::NetworkTrainer trainer(settings, &nn);
+		if (pCommunicator)
+		{
+			std::size_t const leftOut = bpn::keepShard(data.m_trainingSet, pCommunicator->rank(), pCommunicator->size());
+			if (leftOut > 0 && mainProcess && verbosity >= 1)
+			{
+				std::println("{} training entries left out, so that the {} processes train on as many entries",
+					leftOut, pCommunicator->size());
+			}
+			trainer.setCommunicator(pCommunicator);
+		}
+		if (optimizerState != "none" && std::filesystem::exists(optimizerState))
+		{
+			trainer.loadOptimizerState(optimizerState);
+		}
+		if (teacher)
+		{
+			trainer.setTeacher(&*teacher, teacherWeight);
+		}
+
+		trainer.Train(data);
+
+		if (pruneThreshold > 0.0 || pruneSparsity > 0.0)
+		{
+			trainer.Prune(data, pruneThreshold, pruneSparsity, pruneRetrainEpochs);
+		}
+
+		if (!mainProcess)
+		{
+			return 0;
+		}
+
+		if (verbosity >= 2)
+		{
+			std::cout << nn << std::endl;
+		}
+
+		std::ofstream fs(exportFile);
+		fs << nn.serialize() << std::endl;
+
+		if (exportHeader != "none")
+		{
+			std::ofstream(exportHeader) << bpn::generateHeader(nn, "bpn_network");
+		}
+
+		if (optimizerState != "none")
+		{
+			trainer.saveOptimizerState(optimizerState);
+		}
+		if (replay)
+		{
+			replay->save(replayBuffer);
+		}
+
+		if (verbosity >= 1)
+		{
+			std::cout << bpn::MemoryTracker::summary() << std::endl;
+		}
+		return 0;
+	};
+
+	if (processes > 1)
+	{
+		// The processes are forked now, so they share the data read and the
+		// initial weights
+		return bpn::launchProcesses(processes, communicationSize,
+			[&](bpn::Communicator& communicator) { return train(&communicator); }).exitCode;
+	}
+	return train(nullptr);
+}
+catch (const std::exception& e)
+{
+	std::println(std::cerr, "Error: {}", e.what());
+	return 1;
+}